@@ -35,8 +35,8 @@ int main(int argc, char **argv) {
             exit(1);
         }
 
-        // Enable nested parallelism
-		omp_set_nested(1);
+        // Read the tuning parameters of the library from the environment
+        load_tuning();
 
         // Variables -----------------------------------------------------------
 
@@ -53,7 +53,7 @@ int main(int argc, char **argv) {
         MPI_Type_commit(&MPI_DATA_T);
 
         // Define data size and data array
-		int N = (argc > 1) ? atoi(argv[1]) : N_dflt;
+		idx_t N = (argc > 1) ? atoll(argv[1]) : N_dflt;
         data_t *data = NULL;
 
         // Random data generation (only master)
@@ -63,7 +63,7 @@ int main(int argc, char **argv) {
 
         // Define arrays for the local_data
         data_t* local_data = NULL; 
-        int local_size = 0;
+        idx_t local_size = 0;
 
         // Splitting the data
         MPI_Split(data, N, &local_data, &local_size, rank, size, MPI_DATA_T);
@@ -93,6 +93,17 @@ int main(int argc, char **argv) {
             //          MPI_DATA_T,
             //          compare_ge);
 
+            // Node-aware sort ------------------
+            // MPI_Hierarchical_sort(&local_data, &local_size,
+            //                       N, rank, size,
+            //                       MPI_DATA_T,
+            //                       compare_ge);
+
+            // Radix sort -----------------------
+            // MPI_Radix_sort(&local_data, &local_size,
+            //                N, rank, size,
+            //                MPI_DATA_T);
+
             // End time -------------------------
             timer = MPI_Wtime() - timer;
 
@@ -123,13 +134,14 @@ int main(int argc, char **argv) {
         }
         free(ranks);
         MPI_Type_free(&MPI_DATA_T); // Freeing the MPI data type
+        omp_workspace_free();       // Freeing the cached workspace of the sorts
 
         // Finalize MPI --------------------------------------------------------
         MPI_Finalize();
 
     #else
-        int N = (argc > 1) ? atoi(argv[1]) : N_dflt;
-        fprintf(stdout, "This program requires both MPI and OpenMP to be enabled to sort the %d elements.\n", N);
+        idx_t N = (argc > 1) ? atoll(argv[1]) : N_dflt;
+        fprintf(stdout, "This program requires both MPI and OpenMP to be enabled to sort the %lld elements.\n", (long long int)N);
     #endif
 
 	return 0;
@@ -38,8 +38,8 @@ int main(int argc, char **argv) {
             exit(1);
         }
 
-        // Enable nested parallelism
-		omp_set_nested(1);
+        // Read the tuning parameters of the library from the environment
+        load_tuning();
 
         // Repeated trials variables -------------------------------------------
         char *method = (argc > 2) ? argv[2] : "serial";		        // Sorting method
@@ -68,12 +68,12 @@ int main(int argc, char **argv) {
         int correctly_sorted = 1;                           // Correctly sorted boolean
 
         // Define data size and data array
-		int N = (argc > 1) ? atoi(argv[1]) : N_dflt;        // Number of elements
+		idx_t N = (argc > 1) ? atoll(argv[1]) : N_dflt;        // Number of elements
         data_t *data = NULL;                                // Array of data
 
         // Define arrays for the local_data
         data_t* local_data = NULL; 
-        int local_size = 0;
+        idx_t local_size = 0;
 
         // Open a csv file to store the times ----------------------------------
         FILE *file = fopen("datasets/mpi_scaling.csv", "a+");
@@ -116,13 +116,13 @@ int main(int argc, char **argv) {
 
                     // Master appends the results to the csv file
                     if (correctly_sorted) {
-                        fprintf(file, "%s,%s,%d,%d,%d,%e,%.6f,%.6f,%.6f,%.6f\n", 
-                                method, "Yes", processes, nthreads, N, (double)N,
+                        fprintf(file, "%s,%s,%d,%d,%lld,%e,%.6f,%.6f,%.6f,%.6f\n", 
+                                method, "Yes", processes, nthreads, (long long int)N, (double)N,
                                 mean(times, trials), stdev(times, trials), 
                                 min(times, trials), max(times, trials));
                     } else {
-                        fprintf(file, "%s,%s,%d,%d,%d,%e,%.6f,%.6f,%.6f,%.6f\n", 
-                                method, "No", processes, nthreads, N, (double)N,
+                        fprintf(file, "%s,%s,%d,%d,%lld,%e,%.6f,%.6f,%.6f,%.6f\n", 
+                                method, "No", processes, nthreads, (long long int)N, (double)N,
                                 mean(times, trials), stdev(times, trials), 
                                 min(times, trials), max(times, trials));
                     }
@@ -172,25 +172,34 @@ int main(int argc, char **argv) {
                                  MPI_DATA_T,
                                  compare_ge);
                         times[i] = MPI_Wtime() - timer;             // Stop timer
+                    } else if (strcmp(method, "node") == 0) {
+                        timer = MPI_Wtime();                        // Start timer
+                        MPI_Hierarchical_sort(&local_data, &local_size,
+                                              N, rank, size,
+                                              MPI_DATA_T,
+                                              compare_ge);
+                        times[i] = MPI_Wtime() - timer;             // Stop timer
+                    } else if (strcmp(method, "radix") == 0) {
+                        timer = MPI_Wtime();                        // Start timer
+                        MPI_Radix_sort(&local_data, &local_size,
+                                       N, rank, size,
+                                       MPI_DATA_T);
+                        times[i] = MPI_Wtime() - timer;             // Stop timer
                     } else {
                         fprintf(stderr, "ERROR: The sorting method named %s is not available.\n", method);
                         MPI_Finalize();
                         exit(1);
                     }
 
-                    if (mastergen) {
-                        // // Merge the sorted arrays in the master process to verify
-                        MPI_Merge(data, local_data, local_size, rank, size, MPI_DATA_T);
-                        if (rank == 0) {
-                            if (!verify_sorting(data, 0, N))           // Verify sorting
-                                correctly_sorted = 0; // Not correctly sorted !
-                            
-                            //Free memory
-                            if (data != NULL) {
-                                free(data);
-                                data = NULL;
-                            }
-                        }
+                    // Verification of the distributed sorted array, without
+                    // gathering it on the master process
+                    distributed_t sorted = MPI_Distributed(local_data, local_size, MPI_COMM_WORLD);
+                    if (!MPI_Verify_distributed(&sorted) || sorted.global_size != N)
+                        correctly_sorted = 0; // Not correctly sorted !
+
+                    if (data != NULL) {
+                        free(data);
+                        data = NULL;
                     }
 
                     if (local_data != NULL) {
@@ -202,13 +211,13 @@ int main(int argc, char **argv) {
                 // Master appends the results to the csv file
                 if (rank == 0) {
                     if (correctly_sorted) {
-                        fprintf(file, "%s,%s,%d,%d,%d,%e,%.6f,%.6f,%.6f,%.6f\n", 
-                                method, "Yes", processes, nthreads, N, (double)N,
+                        fprintf(file, "%s,%s,%d,%d,%lld,%e,%.6f,%.6f,%.6f,%.6f\n", 
+                                method, "Yes", processes, nthreads, (long long int)N, (double)N,
                                 mean(times, trials), stdev(times, trials), 
                                 min(times, trials), max(times, trials));
                     } else {
-                        fprintf(file, "%s,%s,%d,%d,%d,%e,%.6f,%.6f,%.6f,%.6f\n", 
-                                method, "No", processes, nthreads, N, (double)N,
+                        fprintf(file, "%s,%s,%d,%d,%lld,%e,%.6f,%.6f,%.6f,%.6f\n", 
+                                method, "No", processes, nthreads, (long long int)N, (double)N,
                                 mean(times, trials), stdev(times, trials), 
                                 min(times, trials), max(times, trials));
                     }
@@ -223,6 +232,7 @@ int main(int argc, char **argv) {
 		free(times);
         free(ranks);
         MPI_Type_free(&MPI_DATA_T); // Freeing the MPI data type
+        omp_workspace_free();       // Freeing the cached workspace of the sorts
 
         // Finalize MPI --------------------------------------------------------
         MPI_Finalize();
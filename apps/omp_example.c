@@ -24,12 +24,12 @@ int main(int argc, char **argv) {
             fprintf(stdout, "🚧 Running in DEBUG mode\n");
         #endif
 
-        // Enable nested parallelism
-        omp_set_nested(1);
+        // Read the tuning parameters of the library from the environment
+        load_tuning();
 
         // Variables -----------------------------------------------------------
         struct timespec ts;
-		int N = (argc > 1) ? atoi(argv[1]) : N_dflt;
+		idx_t N = (argc > 1) ? atoll(argv[1]) : N_dflt;
         data_t *data = (data_t *)malloc(N * sizeof(data_t));
         int nthreads = 1;
 
@@ -56,6 +56,11 @@ int main(int argc, char **argv) {
             // #pragma omp single
             // omp_task_qsort(data, 0, N, compare_ge);
 
+            // Task parallel qsort by key -------
+            // #pragma omp parallel
+            // #pragma omp single
+            // omp_task_qsort_by_key(data, 0, N);
+
             // Simple parallel qsort ------------
             // omp_parallel_qsort(data, 0, N, compare_ge, 0);
 
@@ -65,6 +70,12 @@ int main(int argc, char **argv) {
             // PSRS -----------------------------
             // omp_psrs(data, 0, N, compare_ge);
 
+            // Sample sort ----------------------
+            // omp_sample_sort(data, 0, N, compare_ge);
+
+            // Radix sort -----------------------
+            // omp_radix_sort(data, 0, N);
+
             // End time -------------------------
             timer = CPU_TIME - timer;
 
@@ -77,10 +88,11 @@ int main(int argc, char **argv) {
 
         // Freeing memory ------------------------------------------------------
         free(data);
+        omp_workspace_free();       // Freeing the cached workspace of the sorts
 
     #else
-        int N = (argc > 1) ? atoi(argv[1]) : N_dflt;
-        fprintf(stdout, "This program requires OpenMP to be enabled to sort the %d elements.\n", N);
+        idx_t N = (argc > 1) ? atoll(argv[1]) : N_dflt;
+        fprintf(stdout, "This program requires OpenMP to be enabled to sort the %lld elements.\n", (long long int)N);
     #endif
 
 	return 0;
@@ -26,11 +26,11 @@ int main(int argc, char **argv) {
 			fprintf(stdout, "🚧 Running in DEBUG mode\n");
 		#endif
 
-		// Enable nested parallelism
-		omp_set_nested(1);
+		// Read the tuning parameters of the library from the environment
+		load_tuning();
 
         // Variables --------------------------------------------------------------
-        int N = (argc > 1) ? atoi(argv[1]) : N_dflt;		        // Number of elements
+        idx_t N = (argc > 1) ? atoll(argv[1]) : N_dflt;		        // Number of elements
         char *method = (argc > 2) ? argv[2] : "serial";		        // Sorting method
 		data_t *data = NULL;                                        // Array of data
         int trials = (argc > 3) ? atoi(argv[3]) : T_dflt;		    // Number of trials
@@ -40,6 +40,15 @@ int main(int argc, char **argv) {
         int correctly_sorted = 1;                                   // Correctly sorted boolean
         int nthreads = 1;                                           // Number of threads
 
+        // Label of the method in the csv file: the partitioning scheme selected
+        // with QSORT_PARTITION is appended when it is not the default one, so that
+        // the partitioning schemes can be compared on the same sorting method (and
+        // so is the leaf key mode selected with QSORT_LEAF_KEYS)
+        const char *partition_names[] = {"", "-three", "-block"};
+        char label[64];
+        snprintf(label, sizeof(label), "%s%s%s", method, partition_names[qsort_tuning.partition],
+                 qsort_tuning.leaf_keys ? "-leafkeys" : "");
+
         // Open a csv file to store the times ---------------------------------
         FILE *file = fopen("datasets/omp_scaling.csv", "a+");
         if (file != NULL) {
@@ -58,11 +67,14 @@ int main(int argc, char **argv) {
 
 
             // Serial trials
-            if (strcmp(method, "serial") == 0) {
+            if (strcmp(method, "serial") == 0 || strcmp(method, "serial_key") == 0) {
                 for (int i = 0; i < trials; i++) {
                     generate_data(&data, N);                 // Generate data
                     timer = CPU_TIME;                 		// Start timer
-                    serial_qsort(data, 0, N, compare_ge);   // Sort
+                    if (strcmp(method, "serial") == 0)      // Sort
+                        serial_qsort(data, 0, N, compare_ge);
+                    else
+                        serial_qsort_by_key(data, 0, N);
                     times[i] = CPU_TIME - timer;            // Stop timer
                     if (!verify_sorting(data, 0, N))        // Verify sorting
                         correctly_sorted = 0; // Not correctly sorted !
@@ -80,6 +92,7 @@ int main(int argc, char **argv) {
 
                 for (int i = 0; i < trials; i++) {
                     generate_data(&data, N);                     // Generate data
+                    qsort_task_stats = (task_stats_t){0, 0, 0};  // Reset the task counters
 
                     // Timed sorting
                     if (strcmp(method, "task") == 0) {
@@ -91,6 +104,15 @@ int main(int argc, char **argv) {
 
                         times[i] = CPU_TIME - timer;            // Stop timer
 
+                    } else if (strcmp(method, "task_key") == 0) {
+
+                        timer = CPU_TIME;                       // Start timer
+                        #pragma omp parallel
+                        #pragma omp single
+                        omp_task_qsort_by_key(data, 0, N);
+
+                        times[i] = CPU_TIME - timer;            // Stop timer
+
                     } else if (strcmp(method, "simple") == 0) {
 
                         timer = CPU_TIME;                       // Start timer
@@ -109,6 +131,18 @@ int main(int argc, char **argv) {
                         omp_psrs(data, 0, N, compare_ge);
                         times[i] = CPU_TIME - timer;            // Stop timer
 
+                    } else if (strcmp(method, "sample") == 0) {
+
+                        timer = CPU_TIME;                       // Start timer
+                        omp_sample_sort(data, 0, N, compare_ge);
+                        times[i] = CPU_TIME - timer;            // Stop timer
+
+                    } else if (strcmp(method, "radix") == 0) {
+
+                        timer = CPU_TIME;                       // Start timer
+                        omp_radix_sort(data, 0, N);
+                        times[i] = CPU_TIME - timer;            // Stop timer
+
                     } else {
                         fprintf(stderr, "ERROR: The sorting method named %s is not available.\n", method);
                         exit(EXIT_FAILURE);
@@ -116,6 +150,10 @@ int main(int argc, char **argv) {
 
                     if (!verify_sorting(data, 0, N))            // Verify sorting
                         correctly_sorted = 0; // Not correctly sorted !
+                    if (qsort_tuning.report && qsort_task_stats.created > 0)
+                        fprintf(stdout, "Trial %d: %lld tasks created, %lld executed, %lld stolen\n", i,
+                                (long long int)qsort_task_stats.created, (long long int)qsort_task_stats.executed,
+                                (long long int)qsort_task_stats.stolen);
                     // Free memory
                     if (data != NULL) {
                         free(data);
@@ -125,13 +163,13 @@ int main(int argc, char **argv) {
             }
 
             if (correctly_sorted) {
-                fprintf(file, "%s, %s,%d,%d,%e,%.6f,%.6f,%.6f,%.6f\n", 
-                        method, "Yes", nthreads, N, (double)N,
+                fprintf(file, "%s, %s,%d,%lld,%e,%.6f,%.6f,%.6f,%.6f\n", 
+                        label, "Yes", nthreads, (long long int)N, (double)N,
                         mean(times, trials), stdev(times, trials),
                         min(times, trials), max(times, trials));
             } else {
-                fprintf(file, "%s,%s,%d,%d,%e,%.6f,%.6f,%.6f,%.6f\n",
-                        method, "No", nthreads, N, (double)N,
+                fprintf(file, "%s,%s,%d,%lld,%e,%.6f,%.6f,%.6f,%.6f\n",
+                        label, "No", nthreads, (long long int)N, (double)N,
                         mean(times, trials), stdev(times, trials),
                         min(times, trials), max(times, trials));
             }
@@ -146,6 +184,7 @@ int main(int argc, char **argv) {
             free(data);
             data = NULL;
         }
+        omp_workspace_free();       // Freeing the cached workspace of the sorts
 
 	#endif
 
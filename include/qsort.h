@@ -9,9 +9,12 @@
 #include <math.h>
 #include <string.h>
 #include <time.h>
+#include <limits.h>
+#include <stdint.h>
 
 #if defined(_OPENMP)
 	#include <omp.h>
+	#include <sched.h>
 #endif
 
 #if defined(USE_MPI)
@@ -44,11 +47,79 @@
 	#define PRINTF(...)
 #endif
 
+#if defined(DEBUG)
+	// Check of the partitioning of data[start ... end) around data[mid]
+	#define CHECK_PARTITIONING(data, start, end, mid)                               \
+	{                                                                               \
+		if (verify_partitioning(data, start, end, mid))                             \
+		{                                                                           \
+			printf("partitioning is wrong\n");                                      \
+			printf("%4lld, %4lld (%4lld, %g) -> %4lld, %4lld  +  %4lld, %4lld\n",   \
+				(long long int)(start), (long long int)(end), (long long int)(mid), \
+				data[mid].data[HOT], (long long int)(start), (long long int)(mid),  \
+				(long long int)(mid) + 1, (long long int)(end));                    \
+			show_array(data, start, end);                                           \
+		}                                                                           \
+	}
+#endif
+
 #if !defined(DATA_SIZE)
 	#define DATA_SIZE 8
 #endif
 #define HOT 0
 
+// Ranges with at most INSERTION_THRESHOLD elements are sorted by insertion sort
+#if !defined(INSERTION_THRESHOLD)
+	#define INSERTION_THRESHOLD 16
+#endif
+
+// Size of the blocks of the branchless block partitioning (at most 256 since the
+// offsets in the blocks are stored as unsigned char)
+#if !defined(PARTITION_BLOCK_SIZE)
+	#define PARTITION_BLOCK_SIZE 128
+#endif
+_Static_assert(PARTITION_BLOCK_SIZE > 0 && PARTITION_BLOCK_SIZE <= 256, "PARTITION_BLOCK_SIZE must be in [1, 256]");
+
+// Bits of the digits of the radix sorts (2^RADIX_BITS buckets per pass) and size of
+// the buckets below which the comparison sort is used instead
+#if !defined(RADIX_BITS)
+	#define RADIX_BITS 11
+#endif
+#if !defined(RADIX_THRESHOLD)
+	#define RADIX_THRESHOLD 256
+#endif
+
+// Bits of the digit histogram used to split the keys among the processes in the
+// radix sort (MPI)
+#if !defined(RADIX_SPLIT_BITS)
+	#define RADIX_SPLIT_BITS 16
+#endif
+
+// Buckets per level of the sample sort (a power of two, at most 128 since the
+// bucket of each element, with the equality buckets, is stored in an unsigned
+// char), samples per bucket, elements of the per-thread block buffers of each
+// bucket and size of the buckets below which the comparison sort is used instead
+#if !defined(SAMPLE_BUCKETS)
+	#define SAMPLE_BUCKETS 128
+#endif
+#if !defined(SAMPLE_OVERSAMPLING)
+	#define SAMPLE_OVERSAMPLING 8
+#endif
+#if !defined(SAMPLE_BLOCK)
+	#define SAMPLE_BLOCK 8
+#endif
+#if !defined(SAMPLE_THRESHOLD)
+	#define SAMPLE_THRESHOLD 2048
+#endif
+_Static_assert(SAMPLE_BUCKETS >= 2 && SAMPLE_BUCKETS <= 128 && (SAMPLE_BUCKETS & (SAMPLE_BUCKETS - 1)) == 0,
+			   "SAMPLE_BUCKETS must be a power of two in [2, 128]");
+
+// Number of elements sampled by each process to choose the pivot in the recursive
+// sorts (MPI)
+#if !defined(PIVOT_SAMPLES)
+	#define PIVOT_SAMPLES 64
+#endif
+
 // Dfault number of elements to be sorted
 #if (!defined(DEBUG) || defined(_OPENMP))
 	#define N_dflt 100000
@@ -72,13 +143,117 @@ typedef struct {
 	double data[DATA_SIZE];
 } data_t;
 
+// Index type for the positions and the numbers of elements of the arrays: 64 bits,
+// so that the arrays are not limited to INT_MAX elements
+typedef int64_t idx_t;
+
 // Chunk type to represent a portion of the array
 typedef struct {
-    int start;
-    int end;
-	int size;
+    idx_t start;
+    idx_t end;
+	idx_t size;
 } chunk_t;
 
+// Key-index pair type used by the key-index sort mode: instead of moving the
+// whole data_t records while partitioning, only the sort key and the original
+// position of each record are sorted (16 bytes per element) and the records are
+// permuted once at the end
+typedef struct {
+	double key;
+	idx_t index;
+} key_index_t;
+
+// Partitioning schemes used by the sorting kernels
+typedef enum {
+	PARTITION_TWO_WAY,		// two-way partitioning (default)
+	PARTITION_THREE_WAY,	// three-way (fat pivot) partitioning, for inputs with many equal keys
+	PARTITION_BLOCK			// branchless block partitioning (BlockQuicksort)
+} partition_t;
+
+// Pivot selection of the recursive MPI sorts
+typedef enum {
+	PIVOT_ROOT,				// chosen by the first process of the group on its own data (default)
+	PIVOT_SAMPLE			// weighted quantile of a sample gathered from all the processes of the group
+} pivot_t;
+
+// Runtime tuning parameters of the library. They have default values and can be
+// read from the environment with load_tuning() or set directly before sorting
+typedef struct {
+	partition_t partition;	// partitioning scheme (QSORT_PARTITION = two | three | block)
+	int chunk;				// elements per message in the MPI exchanges, 0 for a single message (QSORT_CHUNK)
+	pivot_t pivot;			// pivot selection of the recursive MPI sorts (QSORT_PIVOT = root | sample)
+	int report;				// print the load balance of each level of the recursive MPI sorts (QSORT_REPORT)
+	int oversampling;		// samples per participant of the PSRS algorithms, in multiples of p (QSORT_OVERSAMPLING)
+	double epsilon;			// PSRS refinement cap of the buckets at (1+epsilon)*n/p, 0 to disable (QSORT_EPSILON)
+	int node_size;			// processes per shared memory group of the node-aware sort, 0 for the whole node (QSORT_NODE_SIZE)
+	int leaf_keys;			// serial and task sorts on the (key, index) pairs, records moved once per sort (QSORT_LEAF_KEYS)
+	int task_cutoff;		// ranges sorted serially, without new tasks, by the task sorts (QSORT_TASK_CUTOFF)
+	int task_depth;			// levels of recursion creating tasks in the task sorts, 0 for no limit (QSORT_TASK_DEPTH)
+} tuning_t;
+
+extern tuning_t qsort_tuning;
+
+// Counters of the tasks of the task sorts, accumulated over the calls until they
+// are reset by setting them to zero
+typedef struct {
+	idx_t created;			// tasks created
+	idx_t executed;			// tasks executed
+	idx_t stolen;			// tasks executed by a different thread than the one that created them
+} task_stats_t;
+
+extern task_stats_t qsort_task_stats;
+
+#if defined(_OPENMP)
+// Barrier of a group of threads of a parallel region (see team_barrier()), padded
+// to a cache line so that the barriers of different groups do not share one
+typedef struct {
+	int waiting;			// threads arrived at the current barrier
+	int phase;				// number of completed barriers
+	char padding[64 - 2 * sizeof(int)];
+} team_barrier_t;
+
+// Scratch memory of the OpenMP sorts (see omp_workspace())
+typedef struct {
+	data_t *buffer;				// buffer of the data
+	idx_t size;					// elements of the buffer
+	idx_t *counts;				// counters and prefix sums
+	idx_t counts_size;			// number of counters
+	double *pivots;				// one pivot per thread
+	team_barrier_t *barriers;	// one barrier per thread
+	int threads;				// number of pivots and barriers
+	int busy;					// in use by a sort
+} workspace_t;
+#endif
+
+#if defined(MPI_VERSION)
+// MPI datatype of idx_t
+#define MPI_IDX_T MPI_INT64_T
+
+// Pending chunked exchange of data between two processes (see MPI_Exchange_start())
+typedef struct {
+	MPI_Request *requests;	// receives of the chunks first, then sends
+	int recv_chunks;		// number of chunks to receive
+	int send_chunks;		// number of chunks to send
+	idx_t recv_size;		// number of elements to receive
+	int chunk;				// elements per chunk (INT_MAX for a single message)
+} exchange_t;
+
+// Sorted array distributed over the processes of a communicator (see MPI_Distributed())
+typedef struct {
+	data_t *data;				// local part of the array
+	idx_t size;					// number of local elements
+	idx_t offset;				// global position of the first local element
+	idx_t global_size;			// number of elements of all the processes
+	MPI_Comm comm;				// communicator of the processes sharing the array
+} distributed_t;
+
+// Hierarchy of communicators of the recursive MPI sorts (see MPI_Hypercube())
+typedef struct {
+	MPI_Comm *comms;			// communicator of each recursion level, comms[0] duplicates comm
+	int levels;					// number of levels
+} hypercube_t;
+#endif
+
 // Macros for max and min between two data_t objects
 #define MAX(a, b) ((a)->data[HOT] > (b)->data[HOT] ? (a) : (b));
 #define MIN(a, b) ((a)->data[HOT] < (b)->data[HOT] ? (a) : (b));
@@ -98,20 +273,32 @@ typedef struct {
 		} while (--sz);      \
 	} while (0)
 
+// Type-aware swaps used on the hot paths instead of the byte-wise SWAP macro:
+// the size of the swapped objects is fixed at compile time (by DATA_SIZE for
+// data_t), so the structure copies are compiled to whole-word or SIMD loads and
+// stores. SWAP is kept as a generic fallback for objects of any other size
+static inline void swap_data(data_t *, data_t *);
+static inline void swap_key(key_index_t *, key_index_t *);
+
 // --------------------------------- PROTOTYPES --------------------------------
 
 // Signatures
 typedef int(compare_t)(const void *, const void *);
-typedef int(verify_t)(data_t *, int, int, int);
+typedef int(verify_t)(data_t *, idx_t, idx_t, idx_t);
+
+// Library comparison functions: when one of these is passed to the sorting
+// functions, the kernels specialized for it (with the comparison inlined) are
+// used instead of calling it through the function pointer
+compare_t compare_ge;					// compare for "greater or equal" (ascending order)
+compare_t compare_le;					// compare for "less or equal" (descending order)
 
 
 // Inline functions declarations
 static inline compare_t compare;		// compare function
-static inline compare_t compare_ge; 	// compare for "greater or equal"
 static inline compare_t compare_double; // compare for double
 verify_t verify_partitioning;			// verify partitioning
-int verify_sorting(data_t *, int, int); // verify sorting
-void show_array(data_t *, int, int); 	// print the array
+int verify_sorting(data_t *, idx_t, idx_t); // verify sorting
+void show_array(data_t *, idx_t, idx_t); 	// print the array
 void show_int_array(int *, int, int); 	// print the int array
 void show_double_array(double *, int, int); 	// print the double array
 
@@ -122,39 +309,84 @@ double max(double *, int);				// maximum of an array
 double stdev(double *, int);			// standard deviation of an array
 
 // Partitioning functions
-static inline int partitioning(data_t *, int, int, compare_t);
-static inline int partitioning_low_high(data_t *, int, int, double);
-static inline int binary_search(data_t*, int, int, double);
-static inline int* p_partitioning(data_t *, int, int, double *, int);
+static inline idx_t partitioning(data_t *, idx_t, idx_t, compare_t);
+static inline idx_t partitioning_low_high(data_t *, idx_t, idx_t, double);
+static inline idx_t partitioning_low_high_block(data_t *, idx_t, idx_t, double);
+static inline idx_t binary_search(data_t*, idx_t, idx_t, double);
+static inline idx_t* p_partitioning(data_t *, idx_t, idx_t, double *, int);
+static inline int depth_limit(idx_t);
+#if defined(_OPENMP)
+static inline int task_created(void);
+static inline void task_executed(int);
+static inline void team_barrier(team_barrier_t *, int);
+#endif
+static inline uint64_t radix_key(double);
 
 // Splitting function
-static inline chunk_t split(int, int, int, int);
+static inline chunk_t split(idx_t, idx_t, int, int);
 
-// Merging function
-static inline data_t* merge(data_t *, int, int, data_t *, int, int);
+// Merging functions
+void multiway_merge(data_t **, idx_t *, int, data_t *);		// loser tree merge of sorted runs
+void multiway_split(data_t **, idx_t *, int, idx_t, idx_t *);	// multisequence selection of a rank
 
 // Data generation
-void generate_data(data_t **, int); 	// generate random data
+void generate_data(data_t **, idx_t); 	// generate random data
+
+// Tuning parameters
+void load_tuning(void);					// read the tuning parameters from the environment
+
+// Splitter selection of the PSRS algorithms
+void regular_sample(data_t *, idx_t, idx_t, int, double *);				// regular sample of a sorted array
+idx_t select_splitters(double *, idx_t *, int, int, idx_t, double *);	// splitters from sorted candidates
+
+// Key-index functions
+void extract_keys(data_t *, idx_t, idx_t, key_index_t *); // extract the (key, index) pairs
+void gather_keys(data_t *, idx_t, idx_t, key_index_t *);  // permute the records following the sorted pairs
 
 
 // Sorting functions declaration (serial and parallel)
 
 // Serial quicksort function
-void serial_qsort(data_t *, int, int, compare_t);
+void serial_qsort(data_t *, idx_t, idx_t, compare_t);
+
+// Serial quicksort of key-index pairs and key-index sort of data_t records
+void serial_key_qsort(key_index_t *, idx_t, idx_t);
+void serial_qsort_by_key(data_t *, idx_t, idx_t);
 
 // OpenMP quicksort functions
 #if defined(_OPENMP)
 	// Tasks parallel quicksort function
-	void omp_task_qsort(data_t *, int, int, compare_t);
+	void omp_task_qsort(data_t *, idx_t, idx_t, compare_t);
+
+	// Tasks parallel quicksort of key-index pairs and key-index sort of data_t records
+	void omp_task_key_qsort(key_index_t *, idx_t, idx_t);
+	void omp_task_qsort_by_key(data_t *, idx_t, idx_t);
 
 	// Parallel quicksort function
-	void omp_parallel_qsort(data_t *, int, int, compare_t, int);
+	void omp_parallel_qsort(data_t *, idx_t, idx_t, compare_t, int);
 
 	// Hyperquicksort function
-	void omp_hyperquicksort(data_t *, int, int, compare_t, int);
+	void omp_hyperquicksort(data_t *, idx_t, idx_t, compare_t, int);
+
+	// Thread groups of the recursion of the parallel quicksort and hyperquicksort
+	void omp_group_sort(data_t *, idx_t, idx_t, compare_t, int, int);
 
 	// Parallel Sort by Regular Sampling (PSRS) function
-	void omp_psrs(data_t *, int, int, compare_t);
+	void omp_psrs(data_t *, idx_t, idx_t, compare_t);
+
+	// Parallel sample sort function (super scalar sample sort)
+	void omp_sample_sort(data_t *, idx_t, idx_t, compare_t);
+
+	// Parallel radix sort function (ascending order only)
+	void omp_radix_sort(data_t *, idx_t, idx_t);
+
+	// Workspace of the OpenMP sorts, cached between the calls
+	workspace_t *omp_workspace(idx_t, idx_t, int);
+	void omp_workspace_release(workspace_t *);
+	void omp_workspace_free(void);				// free the cached workspace
+
+	// Parallel multiway merge of sorted runs
+	void omp_multiway_merge(data_t **, idx_t *, int, data_t *, int);
 
 #endif
 
@@ -162,74 +394,185 @@ void serial_qsort(data_t *, int, int, compare_t);
 #if defined(MPI_VERSION)
 
 	// Parallel quicksort function (MPI)
-	void MPI_Parallel_qsort(data_t **, int *, int *, int, MPI_Comm, MPI_Datatype, compare_t);
+	void MPI_Parallel_qsort(data_t **, idx_t *, int *, int, MPI_Comm, MPI_Datatype, compare_t);
 
 	// Hyperquicksort function (MPI)
-	void MPI_Hyperquicksort(data_t **, int *, int *, int, MPI_Comm, MPI_Datatype, compare_t);
+	void MPI_Hyperquicksort(data_t **, idx_t *, int *, int, MPI_Comm, MPI_Datatype, compare_t);
 
 	// Parallel Sort by Regular Sampling (PSRS) function (MPI)
-	void MPI_PSRS(data_t **, int *, int, int, int, MPI_Datatype, compare_t);
+	void MPI_PSRS(data_t **, idx_t *, idx_t, int, int, MPI_Datatype, compare_t);
+	void MPI_PSRS_sorted(data_t **, idx_t *, idx_t, MPI_Comm, MPI_Datatype);	// on sorted local data, any communicator
+
+	// Node-aware sort through shared memory windows (MPI)
+	void MPI_Hierarchical_sort(data_t **, idx_t *, idx_t, int, int, MPI_Datatype, compare_t);
+
+	// Radix sort function (MPI, ascending order only)
+	void MPI_Radix_sort(data_t **, idx_t *, idx_t, int, int, MPI_Datatype);
 
 	// Splitting function (MPI)
-	void MPI_Split(data_t *, int, data_t **, int *, int, int, MPI_Datatype);
+	void MPI_Split(data_t *, idx_t, data_t **, idx_t *, int, int, MPI_Datatype);
 
 	// Merging function (MPI)
-	void MPI_Merge(data_t *, data_t *, int , int, int, MPI_Datatype);
+	void MPI_Merge(data_t *, data_t *, idx_t, int, int, MPI_Datatype);
+
+	// Distributed sorted array and its verification, without gathering it (MPI)
+	distributed_t MPI_Distributed(data_t *, idx_t, MPI_Comm);
+	int MPI_Verify_distributed(distributed_t *);
+
+	// Collectives with idx_t counts and displacements, not limited to INT_MAX elements (MPI)
+	void MPI_Alltoallv_large(data_t *, idx_t *, idx_t *, data_t *, idx_t *, idx_t *, MPI_Comm, MPI_Datatype);
+	void MPI_Scatterv_large(data_t *, idx_t *, idx_t *, data_t *, idx_t, int, MPI_Comm, MPI_Datatype);
+	void MPI_Gatherv_large(data_t *, idx_t, data_t *, idx_t *, idx_t *, int, MPI_Comm, MPI_Datatype);
+
+	// Chunked non-blocking exchange with a partner process (MPI)
+	void MPI_Exchange_start(exchange_t *, data_t *, idx_t, int, data_t *, idx_t, int, MPI_Comm, MPI_Datatype);
+	idx_t MPI_Exchange_wait(exchange_t *, int);	// wait for a chunk, returns the elements received so far
+	void MPI_Exchange_end(exchange_t *);		// wait for all the chunks
+
+	// Cached hierarchy of communicators of the recursive sorts (MPI)
+	hypercube_t *MPI_Hypercube(MPI_Comm);
+
+	// Pivot selection and load balance report of the recursive sorts (MPI)
+	double MPI_Pivot(data_t *, idx_t, int, double, MPI_Comm);
+	void MPI_Balance_report(int, idx_t, int *, int, MPI_Comm);
 
 #endif
 
 // ----------------------------- INLINE FUNCTIONS ------------------------------
 
-// Partitionin functions
-inline int partitioning(data_t *data, int start, int end, compare_t cmp_ge)
-{
-	// Here end is past the last element
-	--end;
-
-	// Swap the elements so that the meadian of [starts], [mid] and [end]
-	// end up in the end place and is later picked as pivot
-	int mid = start + (end - start) / 2;
-	if (cmp_ge((void *)&data[start], (void *)&data[mid]))
-		SWAP((void *)&data[start], (void *)&data[mid], sizeof(data_t));
-	if (cmp_ge((void *)&data[start], (void *)&data[end]))
-		SWAP((void *)&data[start], (void *)&data[end], sizeof(data_t));
-	if (cmp_ge((void *)&data[end], (void *)&data[mid]))
-		SWAP((void *)&data[mid], (void *)&data[end], sizeof(data_t));
-
-	// The last element is the pivot
-	void *pivot = (void *)&data[end];
-
-	// Pointbreak is the index of the semi-last element
-	int pointbreak = end - 1;
-
-	for (int i = start; i <= pointbreak; i++) {
-		// If the element is greater than or equal to the pivot
-		if (cmp_ge((void *)&data[i], pivot)) {
-			// Find the first element from the end that is less than the pivot
-			while ((pointbreak > i) && cmp_ge((void *)&data[pointbreak], pivot))
-				pointbreak--;
-
-			// Swap the elements
-			if (pointbreak > i)
-				SWAP((void *)&data[i], (void *)&data[pointbreak--], sizeof(data_t));
-		}
+// Swap functions
+inline void swap_data(data_t *a, data_t *b) {
+	data_t temp = *a;
+	*a = *b;
+	*b = temp;
+}
+
+inline void swap_key(key_index_t *a, key_index_t *b) {
+	key_index_t temp = *a;
+	*a = *b;
+	*b = temp;
+}
+
+// Maximum recursion depth allowed to the introsort of size elements: 2*log2(size)
+inline int depth_limit(idx_t size) {
+	int depth = 0;
+	for (; size > 1; size >>= 1)
+		depth += 2;
+	return depth;
+}
+
+#if defined(_OPENMP)
+// Counts a new task of the task sorts and returns the id of the creating thread
+inline int task_created(void) {
+	#pragma omp atomic
+	qsort_task_stats.created++;
+	return omp_get_thread_num();
+}
+
+// Counts the execution of a task created by thread creator
+inline void task_executed(int creator) {
+	#pragma omp atomic
+	qsort_task_stats.executed++;
+	if (omp_get_thread_num() != creator) {
+		#pragma omp atomic
+		qsort_task_stats.stolen++;
 	}
+}
+#endif
 
-	// In the end we need to adjust the position of the pivot
-	pointbreak += !cmp_ge((void *)&data[pointbreak], pivot);
-	SWAP((void *)&data[pointbreak], pivot, sizeof(data_t));
+#if defined(_OPENMP)
+// Waits until the count threads of a group have reached the barrier. Unlike the
+// omp barrier it synchronizes only the threads of the group, so that groups of
+// threads of the same parallel region can work on different parts of the array
+inline void team_barrier(team_barrier_t *barrier, int count) {
+	int phase, arrived;
+	#pragma omp atomic read seq_cst
+	phase = barrier->phase;
+	#pragma omp atomic capture seq_cst
+	arrived = ++barrier->waiting;
+
+	if (arrived == count) {
+		// The last thread resets the counter and releases the others
+		#pragma omp atomic write seq_cst
+		barrier->waiting = 0;
+		#pragma omp atomic update seq_cst
+		barrier->phase++;
+	} else {
+		int current;
+		do {
+			sched_yield();
+			#pragma omp atomic read seq_cst
+			current = barrier->phase;
+		} while (current == phase);
+	}
+}
+#endif
 
-	return pointbreak;
+// Order-preserving map of a double key to an unsigned integer: the sign bit of the
+// positive numbers is set and all the bits of the negative ones are flipped, so
+// that the integers compare as the doubles (with -0.0 before 0.0)
+inline uint64_t radix_key(double key) {
+	uint64_t bits;
+	memcpy(&bits, &key, sizeof(bits));
+	return bits ^ ((bits >> 63) ? ~(uint64_t)0 : (uint64_t)1 << 63);
 }
 
-inline int partitioning_low_high(data_t *data, int start, int end, double threshold) {
+// Sorting kernels: the generic one calling the compare_t function and the
+// specialized ones with the comparison inlined (see qsort_kernel.h)
+
+// Generic kernels: partitioning(), sort_kernel() and task_kernel()
+#define KERNEL_TYPE data_t
+#define KERNEL_SUFFIX
+#define KERNEL_GE(A, B) cmp_ge((void *)(A), (void *)(B))
+#define KERNEL_SWAP(A, B) swap_data(A, B)
+#define KERNEL_ARGS , compare_t cmp_ge
+#define KERNEL_PASS , cmp_ge
+#define KERNEL_CHECK CHECK_PARTITIONING
+#include "qsort_kernel.h"
+
+// Ascending order of data[HOT] (same as compare_ge): partitioning_ge(),
+// sort_kernel_ge() and task_kernel_ge()
+#define KERNEL_TYPE data_t
+#define KERNEL_SUFFIX _ge
+#define KERNEL_GE(A, B) ((A)->data[HOT] >= (B)->data[HOT])
+#define KERNEL_SWAP(A, B) swap_data(A, B)
+#define KERNEL_ARGS
+#define KERNEL_PASS
+#define KERNEL_CHECK CHECK_PARTITIONING
+#include "qsort_kernel.h"
+
+// Descending order of data[HOT] (same as compare_le): partitioning_le(),
+// sort_kernel_le() and task_kernel_le()
+#define KERNEL_TYPE data_t
+#define KERNEL_SUFFIX _le
+#define KERNEL_GE(A, B) ((A)->data[HOT] <= (B)->data[HOT])
+#define KERNEL_SWAP(A, B) swap_data(A, B)
+#define KERNEL_ARGS
+#define KERNEL_PASS
+#include "qsort_kernel.h"
+
+// Ascending order of the key-index pairs: partitioning_key(), sort_kernel_key()
+// and task_kernel_key()
+#define KERNEL_TYPE key_index_t
+#define KERNEL_SUFFIX _key
+#define KERNEL_GE(A, B) ((A)->key >= (B)->key)
+#define KERNEL_SWAP(A, B) swap_key(A, B)
+#define KERNEL_ARGS
+#define KERNEL_PASS
+#include "qsort_kernel.h"
+
+// Partitionin functions
+inline idx_t partitioning_low_high(data_t *data, idx_t start, idx_t end, double threshold) {
+	if (qsort_tuning.partition == PARTITION_BLOCK)
+		return partitioning_low_high_block(data, start, end, threshold);
+
 	// The idea is to maintain two pointers: one starting from the left (low) and moving towards right,
 	// and the other starting from the right (high) and moving towards left. The left pointer finds an element
 	// greater than or equal to the pivot (threshold), and the right pointer finds one less than it, then they swap elements.
 	// This continues until the pointers cross
 
-	int low = start - 1;
-	int high = end;
+	idx_t low = start - 1;
+	idx_t high = end;
 
 	while (1) {
 		// Find the first element greater than or equal to the pivot
@@ -249,29 +592,91 @@ inline int partitioning_low_high(data_t *data, int start, int end, double thresh
 			return low;
 
 		// Swap the elements
-		SWAP((void *)&data[low], (void *)&data[high], sizeof(data_t));
+		swap_data(&data[low], &data[high]);
+	}
+}
+
+// Same as partitioning_low_high() with the branchless block partitioning of the
+// kernels (see partitioning_block() in qsort_kernel.h)
+inline idx_t partitioning_low_high_block(data_t *data, idx_t start, idx_t end, double threshold) {
+
+	// Invariant: data[start ... l) < threshold and data[r ... end) >= threshold
+	idx_t l = start, r = end;
+	unsigned char offsets_l[PARTITION_BLOCK_SIZE], offsets_r[PARTITION_BLOCK_SIZE];
+	int num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+
+	while (r - l >= 2 * PARTITION_BLOCK_SIZE) {
+		// Offsets of the elements >= threshold in the left block
+		if (num_l == 0) {
+			start_l = 0;
+			for (int i = 0; i < PARTITION_BLOCK_SIZE; i++) {
+				offsets_l[num_l] = (unsigned char)i;
+				num_l += (data[l + i].data[HOT] >= threshold);
+			}
+		}
+
+		// Offsets of the elements < threshold in the right block
+		if (num_r == 0) {
+			start_r = 0;
+			for (int i = 0; i < PARTITION_BLOCK_SIZE; i++) {
+				offsets_r[num_r] = (unsigned char)i;
+				num_r += (data[r - 1 - i].data[HOT] < threshold);
+			}
+		}
+
+		// Swap the misplaced elements in bulk
+		int num = (num_l < num_r) ? num_l : num_r;
+		for (int j = 0; j < num; j++)
+			swap_data(&data[l + offsets_l[start_l + j]], &data[r - 1 - offsets_r[start_r + j]]);
+
+		num_l -= num;
+		num_r -= num;
+		start_l += num;
+		start_r += num;
+
+		// Move past the blocks with no more misplaced elements
+		if (num_l == 0)
+			l += PARTITION_BLOCK_SIZE;
+		if (num_r == 0)
+			r -= PARTITION_BLOCK_SIZE;
 	}
+
+	// Classic partitioning of what is left in data[l ... r)
+	idx_t i = l, j = r - 1;
+	while (i <= j) {
+		if (data[i].data[HOT] < threshold)
+			i++;
+		else if (data[j].data[HOT] >= threshold)
+			j--;
+		else
+			swap_data(&data[i++], &data[j--]);
+	}
+
+	// Index of the first element >= threshold
+	return i;
 }
 
-inline int* p_partitioning(data_t *data, int start, int end, double *pivots, int p) {
+inline idx_t* p_partitioning(data_t *data, idx_t start, idx_t end, double *pivots, int p) {
 	// Partitioning function that, given a data_t*, a start, a end, a compare_t and an array of p pivots,
 	// returns an array of p+1 integers such that the first index is 0 and the i-th integer is the index 
 	// of the first element in the array that is greater or equal to the i-th pivot
-	int *indexes = (int *)malloc((p+1) * sizeof(int));
+	idx_t *indexes = (idx_t *)malloc((p+1) * sizeof(idx_t));
 
 	// Finding the indexes (with a data array already sorted)
 	indexes[0] = 0;
 	for (int i = 0; i < p; i++) {
-		indexes[i+1] = binary_search(data, start, end, pivots[i]) - start;
+		indexes[i+1] = binary_search(data, start, end - 1, pivots[i]) - start;
 	}
 
 	return indexes;
 }
 
-inline int binary_search(data_t *data, int start, int end, double threshold) {
-    int result = -1;
+// Returns the index of the first element >= threshold in the sorted data[start ... end]
+// (end included), or end+1 if all the elements are < threshold
+inline idx_t binary_search(data_t *data, idx_t start, idx_t end, double threshold) {
+    idx_t result = end + 1;
 	while (start <= end) {
-		int mid = start + (end - start) / 2;
+		idx_t mid = start + (end - start) / 2;
 		if (data[mid].data[HOT] >= threshold) {
 			result = mid;
 			end = mid - 1;
@@ -290,12 +695,6 @@ inline int compare(const void *A, const void *B) {
 	return ((diff > 0) - (diff < 0));
 }
 
-inline int compare_ge(const void *A, const void *B) {
-	data_t *a = (data_t *)A;
-	data_t *b = (data_t *)B;
-	return (a->data[HOT] >= b->data[HOT]);
-}
-
 inline int compare_double(const void* a, const void* b) {
     double arg1 = *(const double*) a;
     double arg2 = *(const double*) b;
@@ -307,9 +706,9 @@ inline int compare_double(const void* a, const void* b) {
 // Split / Merge functions
 
 // Splits an array from start to end in p chunks depending on the id of the process
-inline chunk_t split(int start, int end, int p, int id) {
-	int size = (end - start) / p;
-	int remainder = (end - start) % p;
+inline chunk_t split(idx_t start, idx_t end, int p, int id) {
+	idx_t size = (end - start) / p;
+	idx_t remainder = (end - start) % p;
 	chunk_t chunk;
 	chunk.start = start + id * size + (id < remainder ? id : remainder);
 	chunk.end = chunk.start + size - (id < remainder ? 0 : 1);
@@ -317,14 +716,4 @@ inline chunk_t split(int start, int end, int p, int id) {
 	return chunk;
 }
 
-// Merges two arraya a from start_a to end_a and b from start_b to end_b into a single one
-static inline data_t* merge(data_t *a, int start_a, int end_a, data_t *b, int start_b, int end_b) {
-	int size_a = end_a - start_a;
-    int size_b = end_b - start_b;
-    data_t *merged = (data_t *)malloc((size_a + size_b) * sizeof(data_t));
-    memcpy(merged, a + start_a, size_a * sizeof(data_t));
-    memcpy(merged + size_a, b + start_b, size_b * sizeof(data_t));
-    return merged;
-}
-
 #endif // QSORT_H__
\ No newline at end of file
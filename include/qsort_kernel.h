@@ -0,0 +1,377 @@
+// Sorting kernels template.
+// This file has no include guard on purpose: qsort.h includes it once for every
+// specialization of the kernels, after defining the following macros:
+//
+//   KERNEL_TYPE        type of the sorted elements
+//   KERNEL_SUFFIX      suffix appended to the names of the generated functions
+//   KERNEL_GE(A, B)    true if the element pointed by A must be placed after the
+//                      one pointed by B (or if they are equal)
+//   KERNEL_SWAP(A, B)  swaps the elements pointed by A and B
+//   KERNEL_ARGS        extra parameters of the generated functions (can be empty)
+//   KERNEL_PASS        extra arguments forwarded in the recursive calls (can be empty)
+//   KERNEL_CHECK       (optional) partitioning check called in DEBUG mode
+//
+// When KERNEL_GE is an expression rather than a call through a compare_t pointer
+// the comparison is inlined in the partitioning loop, just like a C++ template.
+// All the macros above are undefined at the end of this file.
+
+#define KERNEL_CAT_(A, B) A##B
+#define KERNEL_CAT(A, B) KERNEL_CAT_(A, B)
+#define KERNEL_NAME(NAME) KERNEL_CAT(NAME, KERNEL_SUFFIX)
+
+// Partitions data[start ... end) around the median of three of the first, middle
+// and last elements and returns the final index of the pivot
+static inline idx_t KERNEL_NAME(partitioning)(KERNEL_TYPE *data, idx_t start, idx_t end KERNEL_ARGS)
+{
+	// Here end is past the last element
+	--end;
+
+	// Swap the elements so that the meadian of [starts], [mid] and [end]
+	// end up in the end place and is later picked as pivot
+	idx_t mid = start + (end - start) / 2;
+	if (KERNEL_GE(&data[start], &data[mid]))
+		KERNEL_SWAP(&data[start], &data[mid]);
+	if (KERNEL_GE(&data[start], &data[end]))
+		KERNEL_SWAP(&data[start], &data[end]);
+	if (KERNEL_GE(&data[end], &data[mid]))
+		KERNEL_SWAP(&data[mid], &data[end]);
+
+	// The last element is the pivot
+	KERNEL_TYPE *pivot = &data[end];
+
+	// Pointbreak is the index of the semi-last element
+	idx_t pointbreak = end - 1;
+
+	for (idx_t i = start; i <= pointbreak; i++) {
+		// If the element is greater than or equal to the pivot
+		if (KERNEL_GE(&data[i], pivot)) {
+			// Find the first element from the end that is less than the pivot
+			while ((pointbreak > i) && KERNEL_GE(&data[pointbreak], pivot))
+				pointbreak--;
+
+			// Swap the elements
+			if (pointbreak > i)
+				KERNEL_SWAP(&data[i], &data[pointbreak--]);
+		}
+	}
+
+	// In the end we need to adjust the position of the pivot
+	pointbreak += !KERNEL_GE(&data[pointbreak], pivot);
+	KERNEL_SWAP(&data[pointbreak], pivot);
+
+	return pointbreak;
+}
+
+// Branchless block partitioning of data[start ... end) (BlockQuicksort), with the
+// same median of three pivot and the same result of partitioning(). The offsets
+// of the misplaced elements of a block of PARTITION_BLOCK_SIZE elements at each
+// end of the range are first collected in two buffers without any conditional
+// branch (the comparison result is added to the buffer counter) and then the
+// misplaced elements are swapped in bulk. The rest of the range that does not
+// fill two blocks is partitioned in the classic way
+static inline idx_t KERNEL_NAME(partitioning_block)(KERNEL_TYPE *data, idx_t start, idx_t end KERNEL_ARGS)
+{
+	idx_t last = end - 1;
+
+	// Median of three in the last place, used as pivot
+	idx_t mid = start + (last - start) / 2;
+	if (KERNEL_GE(&data[start], &data[mid]))
+		KERNEL_SWAP(&data[start], &data[mid]);
+	if (KERNEL_GE(&data[start], &data[last]))
+		KERNEL_SWAP(&data[start], &data[last]);
+	if (KERNEL_GE(&data[last], &data[mid]))
+		KERNEL_SWAP(&data[mid], &data[last]);
+
+	KERNEL_TYPE *pivot = &data[last];
+
+	// Invariant: data[start ... l) < pivot and data[r ... last) >= pivot
+	idx_t l = start, r = last;
+	unsigned char offsets_l[PARTITION_BLOCK_SIZE], offsets_r[PARTITION_BLOCK_SIZE];
+	int num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+
+	while (r - l >= 2 * PARTITION_BLOCK_SIZE) {
+		// Offsets of the elements >= pivot in the left block
+		if (num_l == 0) {
+			start_l = 0;
+			for (int i = 0; i < PARTITION_BLOCK_SIZE; i++) {
+				offsets_l[num_l] = (unsigned char)i;
+				num_l += (KERNEL_GE(&data[l + i], pivot) != 0);
+			}
+		}
+
+		// Offsets of the elements < pivot in the right block
+		if (num_r == 0) {
+			start_r = 0;
+			for (int i = 0; i < PARTITION_BLOCK_SIZE; i++) {
+				offsets_r[num_r] = (unsigned char)i;
+				num_r += (KERNEL_GE(&data[r - 1 - i], pivot) == 0);
+			}
+		}
+
+		// Swap the misplaced elements in bulk
+		int num = (num_l < num_r) ? num_l : num_r;
+		for (int j = 0; j < num; j++)
+			KERNEL_SWAP(&data[l + offsets_l[start_l + j]], &data[r - 1 - offsets_r[start_r + j]]);
+
+		num_l -= num;
+		num_r -= num;
+		start_l += num;
+		start_r += num;
+
+		// Move past the blocks with no more misplaced elements
+		if (num_l == 0)
+			l += PARTITION_BLOCK_SIZE;
+		if (num_r == 0)
+			r -= PARTITION_BLOCK_SIZE;
+	}
+
+	// Classic partitioning of what is left in data[l ... r)
+	idx_t i = l, j = r - 1;
+	while (i <= j) {
+		if (!KERNEL_GE(&data[i], pivot))
+			i++;
+		else if (KERNEL_GE(&data[j], pivot))
+			j--;
+		else
+			KERNEL_SWAP(&data[i++], &data[j--]);
+	}
+
+	// Place the pivot between the two halves
+	KERNEL_SWAP(&data[i], pivot);
+
+	return i;
+}
+
+// Three-way (fat pivot) partitioning of data[start ... end) in the Bentley-McIlroy
+// way: at the end data[start ... *lt) go before the median of three pivot,
+// data[*lt ... *gt) are equal to it and data[*gt ... end) go after it. The
+// elements equal to the pivot are collected at the two ends of the range while
+// scanning and moved to the middle at the end, so that whole runs of equal keys
+// are excluded from the recursion
+static inline void KERNEL_NAME(partitioning3)(KERNEL_TYPE *data, idx_t start, idx_t end, idx_t *lt, idx_t *gt KERNEL_ARGS)
+{
+	idx_t last = end - 1;
+
+	// Median of three in the last place, then moved in the first place
+	idx_t mid = start + (last - start) / 2;
+	if (KERNEL_GE(&data[start], &data[mid]))
+		KERNEL_SWAP(&data[start], &data[mid]);
+	if (KERNEL_GE(&data[start], &data[last]))
+		KERNEL_SWAP(&data[start], &data[last]);
+	if (KERNEL_GE(&data[last], &data[mid]))
+		KERNEL_SWAP(&data[mid], &data[last]);
+	KERNEL_SWAP(&data[start], &data[last]);
+
+	KERNEL_TYPE *pivot = &data[start];
+
+	// Invariant: data[start ... a) == pivot, data[a ... b) < pivot,
+	//            data(c ... d] > pivot,       data(d ... last] == pivot
+	idx_t a = start + 1, b = start + 1;
+	idx_t c = last, d = last;
+
+	while (1) {
+		// Scan from the left while the elements do not go after the pivot
+		while ((b <= c) && KERNEL_GE(pivot, &data[b])) {
+			if (KERNEL_GE(&data[b], pivot))
+				KERNEL_SWAP(&data[a++], &data[b]);
+			b++;
+		}
+
+		// Scan from the right while the elements do not go before the pivot
+		while ((c >= b) && KERNEL_GE(&data[c], pivot)) {
+			if (KERNEL_GE(pivot, &data[c]))
+				KERNEL_SWAP(&data[c], &data[d--]);
+			c--;
+		}
+
+		if (b > c)
+			break;
+
+		KERNEL_SWAP(&data[b++], &data[c--]);
+	}
+
+	// Move the equal elements from the two ends to the middle
+	idx_t s = (a - start < b - a) ? a - start : b - a;
+	for (idx_t i = 0; i < s; i++)
+		KERNEL_SWAP(&data[start + i], &data[b - s + i]);
+
+	s = (d - c < last - d) ? d - c : last - d;
+	for (idx_t i = 0; i < s; i++)
+		KERNEL_SWAP(&data[b + i], &data[end - s + i]);
+
+	*lt = start + (b - a);
+	*gt = end - (d - c);
+}
+
+// Insertion sort of data[start ... end), used for the small ranges
+static inline void KERNEL_NAME(insertion_sort)(KERNEL_TYPE *data, idx_t start, idx_t end KERNEL_ARGS)
+{
+	for (idx_t i = start + 1; i < end; i++) {
+		KERNEL_TYPE temp = data[i];
+		idx_t j = i - 1;
+
+		// Shift right the elements that must go after the current one
+		while ((j >= start) && !KERNEL_GE(&temp, &data[j])) {
+			data[j + 1] = data[j];
+			j--;
+		}
+		data[j + 1] = temp;
+	}
+}
+
+// Moves down the element in position root of the heap stored in data[start ... start+size)
+static inline void KERNEL_NAME(sift_down)(KERNEL_TYPE *data, idx_t start, idx_t root, idx_t size KERNEL_ARGS)
+{
+	idx_t child = 2 * root + 1;
+	while (child < size) {
+		// Pick the child that must go after the other one
+		if ((child + 1 < size) && !KERNEL_GE(&data[start + child], &data[start + child + 1]))
+			child++;
+
+		// Stop when the heap property holds
+		if (KERNEL_GE(&data[start + root], &data[start + child]))
+			return;
+
+		KERNEL_SWAP(&data[start + root], &data[start + child]);
+		root = child;
+		child = 2 * root + 1;
+	}
+}
+
+// Heapsort of data[start ... end), used when the quicksort recursion gets too deep
+static inline void KERNEL_NAME(heap_sort)(KERNEL_TYPE *data, idx_t start, idx_t end KERNEL_ARGS)
+{
+	idx_t size = end - start;
+
+	// Build the heap
+	for (idx_t i = size / 2 - 1; i >= 0; i--)
+		KERNEL_NAME(sift_down)(data, start, i, size KERNEL_PASS);
+
+	// Move the top of the heap to the end of the range one element at a time
+	for (idx_t last = size - 1; last > 0; last--) {
+		KERNEL_SWAP(&data[start], &data[start + last]);
+		KERNEL_NAME(sift_down)(data, start, 0, last KERNEL_PASS);
+	}
+}
+
+// Introsort of data[start ... end): quicksort recursion that switches to the
+// insertion sort on the ranges with at most INSERTION_THRESHOLD elements and to
+// heapsort when depth levels of recursion have been used, in order to guarantee
+// O(n log n) time even on adversarial inputs for the median of three pivot
+static inline void KERNEL_NAME(introsort)(KERNEL_TYPE *data, idx_t start, idx_t end, int depth KERNEL_ARGS)
+{
+	while (end - start > INSERTION_THRESHOLD && end - start > 2) {
+		if (depth-- == 0) { // too many levels: fall back to heapsort
+			KERNEL_NAME(heap_sort)(data, start, end KERNEL_PASS);
+			return;
+		}
+
+		// Bounds of the two halves left to sort: [start, lt) and [gt, end)
+		idx_t lt, gt;
+		if (qsort_tuning.partition == PARTITION_THREE_WAY) {
+			KERNEL_NAME(partitioning3)(data, start, end, &lt, &gt KERNEL_PASS);
+		} else {
+			idx_t mid = (qsort_tuning.partition == PARTITION_BLOCK)
+					? KERNEL_NAME(partitioning_block)(data, start, end KERNEL_PASS)
+					: KERNEL_NAME(partitioning)(data, start, end KERNEL_PASS);
+
+		#if defined(DEBUG) && defined(KERNEL_CHECK)
+			KERNEL_CHECK(data, start, end, mid); // check the partitioning only if DEBUG is defined
+		#endif
+
+			lt = mid;
+			gt = mid + 1;
+		}
+
+		// Recur on the smaller half and loop on the larger one to bound the stack
+		if (lt - start < end - gt) {
+			KERNEL_NAME(introsort)(data, start, lt, depth KERNEL_PASS);
+			start = gt;
+		} else {
+			KERNEL_NAME(introsort)(data, gt, end, depth KERNEL_PASS);
+			end = lt;
+		}
+	}
+
+	KERNEL_NAME(insertion_sort)(data, start, end KERNEL_PASS);
+}
+
+// Serial sort of data[start ... end)
+static inline void KERNEL_NAME(sort_kernel)(KERNEL_TYPE *data, idx_t start, idx_t end KERNEL_ARGS)
+{
+	KERNEL_NAME(introsort)(data, start, end, depth_limit(end - start) KERNEL_PASS);
+}
+
+#if defined(_OPENMP)
+// Task version of the introsort: at each level the smaller half is sorted by a new
+// task and the larger one by the current task. The ranges with at most
+// qsort_tuning.task_cutoff elements, or reached after qsort_tuning.task_depth
+// levels of tasks (levels < 0 for no limit), are sorted serially by the task
+// holding them, so that no tasks are created for small ranges
+static inline void KERNEL_NAME(task_introsort)(KERNEL_TYPE *data, idx_t start, idx_t end, int depth, int levels KERNEL_ARGS)
+{
+	while (1) {
+		idx_t size = end - start;
+		if (size <= qsort_tuning.task_cutoff || size <= INSERTION_THRESHOLD || size <= 2
+			|| levels == 0 || depth == 0) {
+			KERNEL_NAME(introsort)(data, start, end, depth KERNEL_PASS);
+			return;
+		}
+		depth--;
+		levels--;
+
+		// Bounds of the two halves left to sort: [start, lt) and [gt, end)
+		idx_t lt, gt;
+		if (qsort_tuning.partition == PARTITION_THREE_WAY) {
+			KERNEL_NAME(partitioning3)(data, start, end, &lt, &gt KERNEL_PASS);
+		} else {
+			idx_t mid = (qsort_tuning.partition == PARTITION_BLOCK)
+					? KERNEL_NAME(partitioning_block)(data, start, end KERNEL_PASS)
+					: KERNEL_NAME(partitioning)(data, start, end KERNEL_PASS);
+
+		#if defined(DEBUG) && defined(KERNEL_CHECK)
+			KERNEL_CHECK(data, start, end, mid); // check the partitioning only if DEBUG is defined
+		#endif
+
+			lt = mid;
+			gt = mid + 1;
+		}
+
+		// Bounds of the smaller half, sorted by the new task
+		idx_t task_start = start, task_end = lt;
+		if (lt - start < end - gt) {
+			start = gt;
+		} else {
+			task_start = gt;
+			task_end = end;
+			end = lt;
+		}
+
+		int creator = task_created();
+		#pragma omp task firstprivate(task_start, task_end, depth, levels, creator)
+		{
+			task_executed(creator);
+			KERNEL_NAME(task_introsort)(data, task_start, task_end, depth, levels KERNEL_PASS);
+		}
+	}
+}
+
+// Task sort of data[start ... end), to be called inside a parallel region by a
+// single thread
+static inline void KERNEL_NAME(task_kernel)(KERNEL_TYPE *data, idx_t start, idx_t end KERNEL_ARGS)
+{
+	KERNEL_NAME(task_introsort)(data, start, end, depth_limit(end - start),
+								(qsort_tuning.task_depth > 0) ? qsort_tuning.task_depth : -1 KERNEL_PASS);
+}
+#endif
+
+#undef KERNEL_CAT_
+#undef KERNEL_CAT
+#undef KERNEL_NAME
+#undef KERNEL_TYPE
+#undef KERNEL_SUFFIX
+#undef KERNEL_GE
+#undef KERNEL_SWAP
+#undef KERNEL_ARGS
+#undef KERNEL_PASS
+#undef KERNEL_CHECK
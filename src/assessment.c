@@ -1,16 +1,105 @@
 #include "qsort.h"
 
-int verify_sorting(data_t *data, int start, int end) {
-	int i = start;
+// Default tuning parameters
+tuning_t qsort_tuning = {
+	.partition = PARTITION_TWO_WAY,
+	.chunk = 65536,
+	.pivot = PIVOT_ROOT,
+	.report = 0,
+	.oversampling = 1,
+	.epsilon = 0,
+	.node_size = 0,
+	.leaf_keys = 0,
+	.task_cutoff = 4096,
+	.task_depth = 0
+};
+
+// Task counters of the task sorts
+task_stats_t qsort_task_stats = {0, 0, 0};
+
+// Reads the integer environment variable name into value if it is valid and in [min, max]
+static void load_int(const char *name, int *value, int min, int max) {
+	char *string = getenv(name);
+	if (string != NULL) {
+		char *end;
+		long number = strtol(string, &end, 10);
+		if (*string != '\0' && *end == '\0' && number >= min && number <= max)
+			*value = (int)number;
+		else
+			fprintf(stderr, "WARNING: Invalid %s value %s, using the default.\n", name, string);
+	}
+}
+
+// Reads the floating point environment variable name into value if it is valid and in [min, max]
+static void load_double(const char *name, double *value, double min, double max) {
+	char *string = getenv(name);
+	if (string != NULL) {
+		char *end;
+		double number = strtod(string, &end);
+		if (*string != '\0' && *end == '\0' && number >= min && number <= max)
+			*value = number;
+		else
+			fprintf(stderr, "WARNING: Invalid %s value %s, using the default.\n", name, string);
+	}
+}
+
+void load_tuning(void) {
+	char *value = getenv("QSORT_PARTITION");
+	if (value != NULL) {
+		if (strcmp(value, "two") == 0)
+			qsort_tuning.partition = PARTITION_TWO_WAY;
+		else if (strcmp(value, "three") == 0)
+			qsort_tuning.partition = PARTITION_THREE_WAY;
+		else if (strcmp(value, "block") == 0)
+			qsort_tuning.partition = PARTITION_BLOCK;
+		else
+			fprintf(stderr, "WARNING: Unknown QSORT_PARTITION value %s, using the default.\n", value);
+	}
+
+	load_int("QSORT_CHUNK", &qsort_tuning.chunk, 0, INT_MAX);
+
+	value = getenv("QSORT_PIVOT");
+	if (value != NULL) {
+		if (strcmp(value, "root") == 0)
+			qsort_tuning.pivot = PIVOT_ROOT;
+		else if (strcmp(value, "sample") == 0)
+			qsort_tuning.pivot = PIVOT_SAMPLE;
+		else
+			fprintf(stderr, "WARNING: Unknown QSORT_PIVOT value %s, using the default.\n", value);
+	}
+
+	load_int("QSORT_REPORT", &qsort_tuning.report, 0, 1);
+	load_int("QSORT_OVERSAMPLING", &qsort_tuning.oversampling, 1, INT_MAX);
+	load_double("QSORT_EPSILON", &qsort_tuning.epsilon, 0, INFINITY);
+	load_int("QSORT_NODE_SIZE", &qsort_tuning.node_size, 0, INT_MAX);
+	load_int("QSORT_LEAF_KEYS", &qsort_tuning.leaf_keys, 0, 1);
+	load_int("QSORT_TASK_CUTOFF", &qsort_tuning.task_cutoff, 0, INT_MAX);
+	load_int("QSORT_TASK_DEPTH", &qsort_tuning.task_depth, 0, INT_MAX);
+}
+
+int compare_ge(const void *A, const void *B) {
+	data_t *a = (data_t *)A;
+	data_t *b = (data_t *)B;
+	return (a->data[HOT] >= b->data[HOT]);
+}
+
+int compare_le(const void *A, const void *B) {
+	data_t *a = (data_t *)A;
+	data_t *b = (data_t *)B;
+	return (a->data[HOT] <= b->data[HOT]);
+}
+
+int verify_sorting(data_t *data, idx_t start, idx_t end) {
+	idx_t i = start;
 	while ((++i < end) && (data[i].data[HOT] >= data[i - 1].data[HOT]));
 	return (i == end);
 }
 
-int verify_partitioning(data_t *data, int start, int end, int mid) {
+int verify_partitioning(data_t *data, idx_t start, idx_t end, idx_t mid) {
 	int failure = 0;
 	int fail = 0;
 
-	for (int i = start; i < mid; i++)
+	for (idx_t i = start; i < mid; i++)
 		if (compare((void *)&data[i], (void *)&data[mid]) >= 0)
 			fail++;
 
@@ -20,7 +109,7 @@ int verify_partitioning(data_t *data, int start, int end, int mid) {
 		fail = 0;
 	}
 
-	for (int i = mid + 1; i < end; i++)
+	for (idx_t i = mid + 1; i < end; i++)
 		if (compare((void *)&data[i], (void *)&data[mid]) < 0)
 			fail++;
 
@@ -31,10 +120,10 @@ int verify_partitioning(data_t *data, int start, int end, int mid) {
 	return failure;
 }
 
-void show_array(data_t *data, int start, int end) {
+void show_array(data_t *data, idx_t start, idx_t end) {
 	printf("[");
 	printf("\033[1;30m");
-	for (int i = start; i < end-1; i++)
+	for (idx_t i = start; i < end-1; i++)
 		printf("%2.0f, ", data[i].data[HOT]);
 	printf("%2.0f", data[end-1].data[HOT]);
 	printf("\033[0m");	
@@ -42,9 +131,9 @@ void show_array(data_t *data, int start, int end) {
 	
 	// Print indexes below the numbers in gray color
 	printf("\033[1;34m ");
-	for (int i = start; i < end-1; i++)
-		printf("%2d  ", i);
-	printf("%2d\033[0m\n", end-1);	
+	for (idx_t i = start; i < end-1; i++)
+		printf("%2lld  ", (long long int)i);
+	printf("%2lld\033[0m\n", (long long int)(end-1));	
 }
 
 void show_int_array(int *data, int start, int end) {
@@ -105,7 +194,7 @@ double stdev(double *data, int size) {
 	return sqrt(sum / size);
 }
 
-void generate_data(data_t **data, int N) {
+void generate_data(data_t **data, idx_t N) {
     *data = (data_t *)malloc(N * sizeof(data_t));
 
 	#if defined(_OPENMP)
@@ -117,7 +206,7 @@ void generate_data(data_t **data, int N) {
             short unsigned int seeds[3] = {seed - me, seed + me, seed + me * 2};
 
             #pragma omp for
-            for (int i = 0; i < N; i++)
+            for (idx_t i = 0; i < N; i++)
                 (*data)[i].data[HOT] = erand48(seeds);
         }
     #else
@@ -125,14 +214,14 @@ void generate_data(data_t **data, int N) {
         long int seed = time(NULL);
         srand48(seed);
 
-        for (int i = 0; i < N; i++)
+        for (idx_t i = 0; i < N; i++)
             (*data)[i].data[HOT] = drand48();
     #endif
 }
 
 #if defined(MPI_VERSION) && defined(_OPENMP)
 
-void MPI_Split(data_t *data, int N, data_t **local_data, int *local_size, int rank, int size, MPI_Datatype MPI_DATA_T) {
+void MPI_Split(data_t *data, idx_t N, data_t **local_data, idx_t *local_size, int rank, int size, MPI_Datatype MPI_DATA_T) {
 
 	if (size > 1) {
 		// Splitting the data -> each process computes its chunk dimensions
@@ -141,20 +230,27 @@ void MPI_Split(data_t *data, int N, data_t **local_data, int *local_size, int ra
 		// Each process will have a local copy of its data
 		*local_data = (data_t *)malloc(chunk.size * sizeof(data_t));
 
-		// The master process sends the chunks to the other processes
+		// The master process computes the chunks of all the processes and scatters
+		// them in a single collective (its own chunk included)
+		idx_t *counts = NULL;
+		idx_t *displs = NULL;
 		if (rank == 0) {
-			for (int i = 1; i < size; i++) {
+			counts = (idx_t *)malloc(size * sizeof(idx_t));
+			displs = (idx_t *)malloc(size * sizeof(idx_t));
+			for (int i = 0; i < size; i++) {
 				chunk_t other_chunk = split(0, N, size, i);
-				MPI_Send(data + other_chunk.start, other_chunk.size, MPI_DATA_T, i, 0, MPI_COMM_WORLD);
-
-				// The master process also copies its local data
-				memcpy(*local_data, data + chunk.start, chunk.size * sizeof(*data));
+				counts[i] = other_chunk.size;
+				displs[i] = other_chunk.start;
 			}
-		} else {
-			MPI_Recv(*local_data, chunk.size, MPI_DATA_T, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 		}
 
+		MPI_Scatterv_large(data, counts, displs, *local_data, chunk.size, 0, MPI_COMM_WORLD, MPI_DATA_T);
+
 		*local_size = chunk.size;
+
+		// Freeing memory
+		free(counts);
+		free(displs);
 	} else {
 		// if there is only one process, the local data is a copy of the global data
 		*local_size = N;
@@ -163,50 +259,81 @@ void MPI_Split(data_t *data, int N, data_t **local_data, int *local_size, int ra
 	}
 }
 
-void MPI_Merge(data_t *data, data_t *sorted_data, int sorted_size, int rank, int size, MPI_Datatype MPI_DATA_T) {
+void MPI_Merge(data_t *data, data_t *sorted_data, idx_t sorted_size, int rank, int size, MPI_Datatype MPI_DATA_T) {
 
 	if (size > 1) {
         // The root process writes the size of its sorted array in a array of sizes
-        int *sorted_sizes = NULL;
+        idx_t *sorted_sizes = NULL;
+        idx_t *displs = NULL;
         if (rank == 0) {
-            sorted_sizes = (int *)malloc(size * sizeof(int));
+            sorted_sizes = (idx_t *)malloc(size * sizeof(idx_t));
+            displs = (idx_t *)malloc(size * sizeof(idx_t));
         }
 
         // Gather the size of the sorted arrays from the other processes
-        MPI_Gather(&sorted_size, 1, MPI_INT, sorted_sizes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Gather(&sorted_size, 1, MPI_IDX_T, sorted_sizes, 1, MPI_IDX_T, 0, MPI_COMM_WORLD);
 
-        // The root process gaters the sorted arrays from the other processes and fills the final sorted array
+        // The root process computes where the sorted array of each process goes
         if (rank == 0) {
-
-            // Copy the sorted data from the root process
-            #pragma omp parallel for
-            for (int i = 0; i < sorted_size; i++) {
-                data[i] = sorted_data[i];
-            }
-
-            // Gather the sorted data from the other processes
-            int *displs = (int *)malloc(size * sizeof(int));
             displs[0] = 0;
             for (int i = 1; i < size; i++) {
                 displs[i] = displs[i - 1] + sorted_sizes[i - 1];
             }
+        }
 
-			// Gatherv is needed because the size of the sorted arrays can differ in each process
-            MPI_Gatherv(MPI_IN_PLACE, 0, MPI_DATA_T, data, sorted_sizes, displs, MPI_DATA_T, 0, MPI_COMM_WORLD);
+        // Gatherv is needed because the size of the sorted arrays can differ in each process
+        // (the root process data are gathered too)
+        MPI_Gatherv_large(sorted_data, sorted_size, data, sorted_sizes, displs, 0, MPI_COMM_WORLD, MPI_DATA_T);
 
-            // Freeing memory
-            free(displs);
-            free(sorted_sizes);
-        } else {
-            MPI_Gatherv(sorted_data, sorted_size, MPI_DATA_T, NULL, NULL, NULL, MPI_DATA_T, 0, MPI_COMM_WORLD);
-        }
+        // Freeing memory
+        free(displs);
+        free(sorted_sizes);
 	} else {
 		// Copy the sorted data from the root process
 		#pragma omp parallel for
-		for (int i = 0; i < sorted_size; i++) {
+		for (idx_t i = 0; i < sorted_size; i++) {
 			data[i] = sorted_data[i];
 		}
 	}
 }
 
+// Describes the sorted array distributed over the processes of comm, where the
+// process of rank i owns local_data[0 ... local_size), which follows in the global
+// order the data of the processes of rank < i. Nothing is gathered on any process
+distributed_t MPI_Distributed(data_t *local_data, idx_t local_size, MPI_Comm comm) {
+	distributed_t array;
+	array.data = local_data;
+	array.size = local_size;
+	array.comm = comm;
+
+	int rank;
+	MPI_Comm_rank(comm, &rank);
+	MPI_Exscan(&local_size, &array.offset, 1, MPI_IDX_T, MPI_SUM, comm);
+	if (rank == 0)
+		array.offset = 0;
+	MPI_Allreduce(&local_size, &array.global_size, 1, MPI_IDX_T, MPI_SUM, comm);
+
+	return array;
+}
+
+// Verifies the sorting of a distributed array without gathering it: each process
+// checks its local data and that its first element is not smaller than the largest
+// element of the processes before it. Returns the same result on all the processes
+int MPI_Verify_distributed(distributed_t *array) {
+	int rank;
+	MPI_Comm_rank(array->comm, &rank);
+
+	int sorted = (array->size == 0) || verify_sorting(array->data, 0, array->size);
+
+	// Largest element of the processes before this one (-inf if they have no data)
+	double last = (array->size > 0) ? array->data[array->size - 1].data[HOT] : -INFINITY;
+	double previous = -INFINITY;
+	MPI_Exscan(&last, &previous, 1, MPI_DOUBLE, MPI_MAX, array->comm);
+	if (rank > 0 && array->size > 0 && array->data[0].data[HOT] < previous)
+		sorted = 0;
+
+	MPI_Allreduce(MPI_IN_PLACE, &sorted, 1, MPI_INT, MPI_LAND, array->comm);
+	return sorted;
+}
+
 #endif
\ No newline at end of file
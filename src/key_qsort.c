@@ -0,0 +1,79 @@
+#include "qsort.h"
+
+// Fills keys[0 ... end-start) with the (key, index) pairs of data[start ... end)
+void extract_keys(data_t *data, idx_t start, idx_t end, key_index_t *keys) {
+	for (idx_t i = start; i < end; i++) {
+		keys[i - start].key = data[i].data[HOT];
+		keys[i - start].index = i;
+	}
+}
+
+// Permutes data[start ... end) so that the i-th record becomes the one pointed by
+// keys[i].index, every record is read and written exactly once
+void gather_keys(data_t *data, idx_t start, idx_t end, key_index_t *keys) {
+	idx_t size = end - start;
+	data_t *sorted = (data_t *)malloc(size * sizeof(data_t));
+
+	for (idx_t i = 0; i < size; i++)
+		sorted[i] = data[keys[i].index];
+
+	memcpy(data + start, sorted, size * sizeof(data_t));
+	free(sorted);
+}
+
+void serial_key_qsort(key_index_t *keys, idx_t start, idx_t end) {
+	sort_kernel_key(keys, start, end);
+}
+
+// Sorts the records in data[start ... end) by their data[HOT] key moving only the
+// key-index pairs during the sort and permuting the records once at the end
+void serial_qsort_by_key(data_t *data, idx_t start, idx_t end) {
+	idx_t size = end - start;
+	if (size < 2) { return; }
+
+	key_index_t *keys = (key_index_t *)malloc(size * sizeof(key_index_t));
+	extract_keys(data, start, end, keys);
+	serial_key_qsort(keys, 0, size);
+	gather_keys(data, start, end, keys);
+	free(keys);
+}
+
+#if defined(_OPENMP)
+
+void omp_task_key_qsort(key_index_t *keys, idx_t start, idx_t end) {
+	task_kernel_key(keys, start, end);
+}
+
+// Same as serial_qsort_by_key() with the sort, the extraction and the permutation
+// done by tasks. Like omp_task_qsort() it must be called inside a parallel region
+// by a single thread
+void omp_task_qsort_by_key(data_t *data, idx_t start, idx_t end) {
+	idx_t size = end - start;
+	if (size < 2) { return; }
+
+	key_index_t *keys = (key_index_t *)malloc(size * sizeof(key_index_t));
+	data_t *sorted = (data_t *)malloc(size * sizeof(data_t));
+
+	#pragma omp taskloop
+	for (idx_t i = start; i < end; i++) {
+		keys[i - start].key = data[i].data[HOT];
+		keys[i - start].index = i;
+	}
+
+	// The taskgroup waits for all the recursively generated tasks
+	#pragma omp taskgroup
+	omp_task_key_qsort(keys, 0, size);
+
+	#pragma omp taskloop
+	for (idx_t i = 0; i < size; i++)
+		sorted[i] = data[keys[i].index];
+
+	#pragma omp taskloop
+	for (idx_t i = 0; i < size; i++)
+		data[start + i] = sorted[i];
+
+	free(sorted);
+	free(keys);
+}
+
+#endif
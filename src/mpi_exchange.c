@@ -0,0 +1,58 @@
+#include "qsort.h"
+
+#if defined(MPI_VERSION) && defined(_OPENMP)
+
+// Number of messages needed to move size elements in chunks of chunk elements
+static inline int count_chunks(idx_t size, int chunk) {
+    if (size == 0) { return 0; }
+    return (int)((size + chunk - 1) / chunk);
+}
+
+// Starts the exchange of data between processes: send_data[0 ... send_size) is sent
+// to dest and recv_data[0 ... recv_size) is received from source in chunks of
+// qsort_tuning.chunk elements, all posted at once with non-blocking calls so that
+// the caller can work on the chunks as soon as they arrive (in order) with
+// MPI_Exchange_wait(). Either side can be MPI_PROC_NULL with a size of 0. A single
+// message (chunk 0) still is split in pieces of at most INT_MAX elements
+void MPI_Exchange_start(exchange_t *exchange,
+                        data_t *send_data, idx_t send_size, int dest,
+                        data_t *recv_data, idx_t recv_size, int source,
+                        MPI_Comm comm, MPI_Datatype MPI_DATA_T) {
+
+    exchange->chunk = (qsort_tuning.chunk > 0) ? qsort_tuning.chunk : INT_MAX;
+    exchange->recv_size = recv_size;
+    exchange->send_chunks = count_chunks(send_size, exchange->chunk);
+    exchange->recv_chunks = count_chunks(recv_size, exchange->chunk);
+    exchange->requests = (MPI_Request *)malloc((exchange->send_chunks + exchange->recv_chunks) * sizeof(MPI_Request));
+
+    // Receives first, so that the chunks can be delivered directly in recv_data
+    for (int c = 0; c < exchange->recv_chunks; c++) {
+        idx_t first = (idx_t)c * exchange->chunk;
+        int count = (int)((recv_size - first > exchange->chunk) ? exchange->chunk : recv_size - first);
+        MPI_Irecv(recv_data + first, count, MPI_DATA_T, source, 0, comm, &exchange->requests[c]);
+    }
+
+    for (int c = 0; c < exchange->send_chunks; c++) {
+        idx_t first = (idx_t)c * exchange->chunk;
+        int count = (int)((send_size - first > exchange->chunk) ? exchange->chunk : send_size - first);
+        MPI_Isend(send_data + first, count, MPI_DATA_T, dest, 0, comm, &exchange->requests[exchange->recv_chunks + c]);
+    }
+}
+
+// Waits for the c-th received chunk and returns the number of elements of
+// recv_data that are available (all the chunks before c have arrived too)
+idx_t MPI_Exchange_wait(exchange_t *exchange, int c) {
+    MPI_Wait(&exchange->requests[c], MPI_STATUS_IGNORE);
+    if (c == exchange->recv_chunks - 1)
+        return exchange->recv_size;
+    return (idx_t)(c + 1) * exchange->chunk;
+}
+
+// Completes all the pending sends and receives of the exchange, after that the
+// send buffer can be freed and the receive buffer is complete
+void MPI_Exchange_end(exchange_t *exchange) {
+    MPI_Waitall(exchange->send_chunks + exchange->recv_chunks, exchange->requests, MPI_STATUSES_IGNORE);
+    free(exchange->requests);
+}
+
+#endif
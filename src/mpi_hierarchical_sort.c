@@ -0,0 +1,158 @@
+#include "qsort.h"
+
+#if defined(MPI_VERSION) && defined(_OPENMP)
+
+// Groups of processes sharing memory: the processes of the same node (or with
+// qsort_tuning.node_size > 0 at most that many consecutive processes of a node),
+// and the communicator of the first process of each group (MPI_COMM_NULL on the
+// others). Returns 0 if some group is not made of consecutive ranks, since then
+// the sorted groups would not be in the order of the ranks
+static int node_groups(MPI_Comm *node_comm, MPI_Comm *leaders_comm, int rank) {
+    MPI_Comm shared_comm;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &shared_comm);
+
+    if (qsort_tuning.node_size > 0) {
+        int shared_rank;
+        MPI_Comm_rank(shared_comm, &shared_rank);
+        MPI_Comm_split(shared_comm, shared_rank / qsort_tuning.node_size, shared_rank, node_comm);
+        MPI_Comm_free(&shared_comm);
+    } else {
+        *node_comm = shared_comm;
+    }
+
+    int node_rank, node_size;
+    MPI_Comm_rank(*node_comm, &node_rank);
+    MPI_Comm_size(*node_comm, &node_size);
+    MPI_Comm_split(MPI_COMM_WORLD, (node_rank == 0) ? 0 : MPI_UNDEFINED, rank, leaders_comm);
+
+    int first_rank, last_rank;
+    MPI_Allreduce(&rank, &first_rank, 1, MPI_INT, MPI_MIN, *node_comm);
+    MPI_Allreduce(&rank, &last_rank, 1, MPI_INT, MPI_MAX, *node_comm);
+    int consecutive = (last_rank - first_rank + 1 == node_size);
+    MPI_Allreduce(MPI_IN_PLACE, &consecutive, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+
+    return consecutive;
+}
+
+// Node-aware (two-level) sort (MPI): the processes of each node sort their data,
+// merge them through a shared memory window and only the first process of each
+// node takes part in the PSRS exchange across the nodes, so that the network sees
+// one message per pair of nodes instead of one per pair of processes. The sorted
+// partition of each node is then split evenly among its processes
+void MPI_Hierarchical_sort(data_t **local_data, idx_t *local_size,
+                           idx_t global_size, int rank, int size,
+                           MPI_Datatype MPI_DATA_T,
+                           compare_t cmp_ge) {
+
+    MPI_Comm node_comm, leaders_comm;
+    if (!node_groups(&node_comm, &leaders_comm, rank)) {
+        // Processes placed round-robin on the nodes: plain PSRS on all of them
+        if (rank == 0)
+            fprintf(stderr, "WARNING: The nodes do not hold consecutive ranks, using MPI_PSRS.\n");
+        MPI_Comm_free(&node_comm);
+        if (leaders_comm != MPI_COMM_NULL)
+            MPI_Comm_free(&leaders_comm);
+        MPI_PSRS(local_data, local_size, global_size, rank, size, MPI_DATA_T, cmp_ge);
+        return;
+    }
+
+    int node_rank, node_size;
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+
+    // Each process sorts its local data
+    #pragma omp parallel
+    #pragma omp single
+    omp_task_qsort(*local_data, 0, *local_size, cmp_ge);
+
+    // Position of the data of each process in the node
+    idx_t *node_sizes = (idx_t *)malloc(node_size * sizeof(idx_t));
+    idx_t *node_displs = (idx_t *)malloc(node_size * sizeof(idx_t));
+    MPI_Allgather(local_size, 1, MPI_IDX_T, node_sizes, 1, MPI_IDX_T, node_comm);
+    node_displs[0] = 0;
+    for (int i = 1; i < node_size; i++)
+        node_displs[i] = node_displs[i-1] + node_sizes[i-1];
+    idx_t node_n = node_displs[node_size-1] + node_sizes[node_size-1];
+
+    // Shared window owned by the first process of the node: the sorted runs of the
+    // processes in the first half and their merge in the second half
+    data_t *window;
+    MPI_Win win;
+    MPI_Aint window_size;
+    int disp_unit;
+    MPI_Win_allocate_shared((node_rank == 0) ? 2 * (MPI_Aint)node_n * sizeof(data_t) : 0,
+                            sizeof(data_t), MPI_INFO_NULL, node_comm, &window, &win);
+    MPI_Win_shared_query(win, 0, &window_size, &disp_unit, &window);
+    data_t *node_runs = window;
+    data_t *node_merged = window + node_n;
+
+    MPI_Win_fence(0, win);
+    memcpy(node_runs + node_displs[node_rank], *local_data, *local_size * sizeof(data_t));
+    free(*local_data);
+    MPI_Win_fence(0, win);
+
+    // All the processes of the node merge the runs, each one an equal portion of
+    // the output delimited by a multisequence selection
+    data_t **runs = (data_t **)malloc(node_size * sizeof(data_t *));
+    idx_t *first = (idx_t *)malloc(node_size * sizeof(idx_t));
+    idx_t *last = (idx_t *)malloc(node_size * sizeof(idx_t));
+    for (int i = 0; i < node_size; i++)
+        runs[i] = node_runs + node_displs[i];
+    chunk_t portion = split(0, node_n, node_size, node_rank);
+    multiway_split(runs, node_sizes, node_size, portion.start, first);
+    multiway_split(runs, node_sizes, node_size, portion.start + portion.size, last);
+    for (int i = 0; i < node_size; i++) {
+        runs[i] += first[i];
+        last[i] -= first[i];
+    }
+
+    #pragma omp parallel
+    #pragma omp single
+    omp_multiway_merge(runs, last, node_size, node_merged + portion.start, omp_get_num_threads());
+
+    MPI_Win_fence(0, win);
+
+    // The first process of each node sorts the data of the nodes with PSRS among
+    // the other first processes (the node data are already sorted)
+    data_t *node_data = NULL;
+    idx_t node_data_size = 0;
+    if (node_rank == 0) {
+        node_data_size = node_n;
+        node_data = (data_t *)malloc(node_n * sizeof(data_t));
+        memcpy(node_data, node_merged, node_n * sizeof(data_t));
+        MPI_PSRS_sorted(&node_data, &node_data_size, global_size, leaders_comm, MPI_DATA_T);
+    }
+    MPI_Win_free(&win);
+
+    // The sorted partition of the node is shared again in a window and split evenly
+    // among the processes of the node
+    MPI_Bcast(&node_data_size, 1, MPI_IDX_T, 0, node_comm);
+    MPI_Win_allocate_shared((node_rank == 0) ? (MPI_Aint)node_data_size * sizeof(data_t) : 0,
+                            sizeof(data_t), MPI_INFO_NULL, node_comm, &window, &win);
+    MPI_Win_shared_query(win, 0, &window_size, &disp_unit, &window);
+
+    MPI_Win_fence(0, win);
+    if (node_rank == 0)
+        memcpy(window, node_data, node_data_size * sizeof(data_t));
+    MPI_Win_fence(0, win);
+
+    chunk_t chunk = split(0, node_data_size, node_size, node_rank);
+    *local_size = chunk.size;
+    *local_data = (data_t *)malloc(chunk.size * sizeof(data_t));
+    memcpy(*local_data, window + chunk.start, chunk.size * sizeof(data_t));
+    MPI_Win_fence(0, win);
+    MPI_Win_free(&win);
+
+    // Freeing memory
+    free(node_data);
+    free(node_sizes);
+    free(node_displs);
+    free(runs);
+    free(first);
+    free(last);
+    MPI_Comm_free(&node_comm);
+    if (leaders_comm != MPI_COMM_NULL)
+        MPI_Comm_free(&leaders_comm);
+}
+
+#endif
@@ -0,0 +1,59 @@
+#include "qsort.h"
+
+#if defined(MPI_VERSION) && defined(_OPENMP)
+
+// Attribute key of the hierarchies, created by the first call of MPI_Hypercube()
+static int hypercube_key = MPI_KEYVAL_INVALID;
+
+// Frees the hierarchy attached to a communicator, called by MPI when the
+// communicator is freed (or at MPI_Finalize() for the predefined ones)
+static int hypercube_delete(MPI_Comm comm, int key, void *value, void *extra_state) {
+    (void)comm; (void)key; (void)extra_state;
+    hypercube_t *cube = (hypercube_t *)value;
+    for (int l = 0; l < cube->levels; l++)
+        MPI_Comm_free(&cube->comms[l]);
+    free(cube->comms);
+    free(cube);
+    return MPI_SUCCESS;
+}
+
+// Returns the hierarchy of communicators used by the recursive MPI sorts on comm:
+// level 0 is (a duplicate of) comm itself and each following level is the half of
+// the previous one (the first size/2 processes or the others) the process belongs
+// to, down to a single process. The hierarchy is built on the first call, which is
+// collective on comm, and attached to comm as an attribute, so that the following
+// calls reuse it without communication and it is freed together with comm
+hypercube_t *MPI_Hypercube(MPI_Comm comm) {
+
+    if (hypercube_key == MPI_KEYVAL_INVALID)
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, hypercube_delete, &hypercube_key, NULL);
+
+    hypercube_t *cube;
+    int found;
+    MPI_Comm_get_attr(comm, hypercube_key, &cube, &found);
+    if (found)
+        return cube;
+
+    cube = (hypercube_t *)malloc(sizeof(hypercube_t));
+
+    // Number of levels (the last one with a single process)
+    int size;
+    MPI_Comm_size(comm, &size);
+    cube->levels = 1;
+    for (int s = size; s > 1; s -= s/2)
+        cube->levels++;
+
+    cube->comms = (MPI_Comm *)malloc(cube->levels * sizeof(MPI_Comm));
+    MPI_Comm_dup(comm, &cube->comms[0]);
+    for (int l = 1; l < cube->levels; l++) {
+        int rank, level_size;
+        MPI_Comm_rank(cube->comms[l-1], &rank);
+        MPI_Comm_size(cube->comms[l-1], &level_size);
+        MPI_Comm_split(cube->comms[l-1], rank < level_size/2, rank, &cube->comms[l]);
+    }
+
+    MPI_Comm_set_attr(comm, hypercube_key, cube);
+    return cube;
+}
+
+#endif
@@ -2,132 +2,174 @@
 
 #if defined(MPI_VERSION) && defined(_OPENMP)
 
-// Hyperquicksort function (MPI)
-void MPI_Hyperquicksort(data_t **local_data, int *local_size, 
-                        int *ranks, int size,
-                        MPI_Comm comm, MPI_Datatype MPI_DATA_T,
-                        compare_t cmp_ge) {
+// Recursive step of the hyperquicksort (MPI) at the given level of the hierarchy,
+// the local data of each process must be already sorted and stays sorted after
+// every exchange
+static void hyperquicksort(data_t **local_data, idx_t *local_size,
+                           int *ranks, int size,
+                           hypercube_t *cube, int level, MPI_Datatype MPI_DATA_T) {
 
     if (size > 1) {
 
-        if(size % 2 != 0) {
-            fprintf(stdout, "ERROR: Odd number of processes in MPI_Hyperquicksort.\n");
-            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-        }
-
-        // Divide the processes in the communicator in 2 groups
+        // The processes in the communicator of this level are divided in 2 groups: the
+        // low one (rank < half) and the high one (rank >= half). With an odd number of
+        // processes the last one has no partner in the low group: it sends its "low"
+        // partition to the last process of the low group (the host) and keeps the rest
+        MPI_Comm comm = cube->comms[level];
         int rank; // rank in the recursive call
         MPI_Comm_rank(comm, &rank);
-        int *low_processes  = (int *)malloc((size/2) * sizeof(int));
-        int *high_processes = (int *)malloc((size/2) * sizeof(int));
-        for (int i = 0; i < size/2; i++) {
-            low_processes[i]  = ranks[i];          // rank <  size/2
-            high_processes[i] = ranks[i + size/2]; // rank >= size/2
-        }
-
-        // Each process sorts its local data
-        #pragma omp parallel
-        #pragma omp single
-        omp_task_qsort(*local_data, 0, *local_size, cmp_ge);
+        int half = size/2;
+        int unpaired = (size % 2 != 0 && rank == size - 1);
+        int partner  = (rank < half) ? rank + half : (unpaired ? MPI_PROC_NULL : rank - half);
+        int host     = unpaired ? half - 1 : MPI_PROC_NULL;
+        int guest    = (size % 2 != 0 && rank == half - 1) ? size - 1 : MPI_PROC_NULL;
 
-        // Master process picks median pivot in its chunk and broadcasts it
-        double pivot = (*local_data)[(*local_size) / 2].data[HOT];
-        MPI_Bcast(&pivot, 1, MPI_DOUBLE, 0, comm);
+        // The pivot leaves to the low group a share of the data proportional to its
+        // number of processes
+        double pivot = MPI_Pivot(*local_data, *local_size, 1, (double)half / size, comm);
 
         // Each process partitions its chunk according to the pivot
-        int mid = binary_search(*local_data, 0, *local_size, pivot);
-        if (mid == -1){
-            printf("ERROR: The mid has not been found in MPI_Hyperquicksort.\n");
-            exit(1);
-        }
+        idx_t mid = binary_search(*local_data, 0, *local_size - 1, pivot);
 
         // Each process in the low group sends the size of its "high" partition (from mid included to end excluded)
         // to one process of the high group and receives from it the size of the "low" partition (from start included
-        // to mid excluded) in a sendrecv operation
-        int new_size  = 0;
-        int low_size  = mid;
-        int high_size = *local_size - mid;
-
-        if (rank < size/2) {
-            MPI_Sendrecv(&high_size,    1,   MPI_INT,        // adress send buffer, count send elements, type of send elements
-                         rank + size/2, 0,                   // rank of the process to send to, tag
-                         &new_size,     1,   MPI_INT,        // adress receive buffer, count receive elements, type of receive elements
-                         rank + size/2, 0,                   // rank of the process to receive from, tag
+        // to mid excluded) in a sendrecv operation. The unpaired process sends the size of its "low" partition to
+        // the host (send and receive with MPI_PROC_NULL do nothing)
+        idx_t new_size   = 0;
+        idx_t guest_size = 0;
+        idx_t low_size   = mid;
+        idx_t high_size  = *local_size - mid;
+
+        if (rank < half) {
+            MPI_Sendrecv(&high_size,    1,   MPI_IDX_T,      // adress send buffer, count send elements, type of send elements
+                         partner,       0,                   // rank of the process to send to, tag
+                         &new_size,     1,   MPI_IDX_T,      // adress receive buffer, count receive elements, type of receive elements
+                         partner,       0,                   // rank of the process to receive from, tag
                          comm, MPI_STATUS_IGNORE);           // communicator, status
+            MPI_Recv(&guest_size, 1, MPI_IDX_T, guest, 0, comm, MPI_STATUS_IGNORE);
         } else {
-            MPI_Sendrecv(&low_size,    1,   MPI_INT,         // adress send buffer, count send elements, type of send elements
-                         rank - size/2, 0,                   // rank of the process to send to, tag
-                         &new_size,     1,   MPI_INT,        // adress receive buffer, count receive elements, type of receive elements
-                         rank - size/2, 0,                   // rank of the process to receive from, tag
+            MPI_Sendrecv(&low_size,     1,   MPI_IDX_T,      // adress send buffer, count send elements, type of send elements
+                         unpaired ? host : partner, 0,       // rank of the process to send to, tag
+                         &new_size,     1,   MPI_IDX_T,      // adress receive buffer, count receive elements, type of receive elements
+                         partner,       0,                   // rank of the process to receive from, tag
                          comm, MPI_STATUS_IGNORE);           // communicator, status
         }
 
-        // Allocate memory for the incoming data
+        // Allocate memory for the incoming data and for the new local data
         data_t *incoming_data = (data_t *)malloc(new_size * sizeof(data_t));
-
-        // Each process of the low group send its "high" partition to one process of the high group
-        // and receives the "low" partition from that same other process in a sendrecv operation
-        if (rank < size/2) {
-            MPI_Sendrecv(&(*local_data)[mid], high_size, MPI_DATA_T,
-                         rank + size/2, 0,
-                         incoming_data, new_size, MPI_DATA_T,
-                         rank + size/2, 0,
-                         comm, MPI_STATUS_IGNORE);
+        *local_size = (rank < half) ? low_size + new_size + guest_size : high_size + new_size;
+        data_t *merged = (data_t *)malloc(*local_size * sizeof(data_t));
+
+        // Each process of the low group sends its "high" partition to one process of the high group
+        // and receives the "low" partition from that same other process, in chunks
+        exchange_t exchange;
+        data_t *kept = NULL;
+        data_t *kept_guest = NULL;
+        idx_t kept_size = 0;
+        if (rank < half) {
+            MPI_Exchange_start(&exchange,
+                               &(*local_data)[mid], high_size, partner,
+                               incoming_data, new_size, partner,
+                               comm, MPI_DATA_T);
+            kept = &(*local_data)[0];
+            kept_size = low_size;
+
+            // The host receives the "low" partition of the unpaired process too and merges it
+            // with the kept partition while the data from the partner are in flight
+            if (guest_size > 0) {
+                exchange_t guest_exchange;
+                data_t *guest_data = (data_t *)malloc(guest_size * sizeof(data_t));
+                MPI_Exchange_start(&guest_exchange,
+                                   NULL, 0, MPI_PROC_NULL,
+                                   guest_data, guest_size, guest,
+                                   comm, MPI_DATA_T);
+                MPI_Exchange_end(&guest_exchange);
+
+                data_t *runs[2] = {kept, guest_data};
+                idx_t run_sizes[2] = {kept_size, guest_size};
+                kept_guest = (data_t *)malloc((kept_size + guest_size) * sizeof(data_t));
+
+                #pragma omp parallel
+                #pragma omp single
+                omp_multiway_merge(runs, run_sizes, 2, kept_guest, omp_get_num_threads());
+
+                free(guest_data);
+                kept = kept_guest;
+                kept_size += guest_size;
+            }
         } else {
-            MPI_Sendrecv(&(*local_data)[0], low_size, MPI_DATA_T,
-                         rank - size/2, 0,
-                         incoming_data, new_size, MPI_DATA_T,
-                         rank - size/2, 0,
-                         comm, MPI_STATUS_IGNORE);
+            MPI_Exchange_start(&exchange,
+                               &(*local_data)[0], low_size, unpaired ? host : partner,
+                               incoming_data, new_size, partner,
+                               comm, MPI_DATA_T);
+            kept = &(*local_data)[mid];
+            kept_size = high_size;
         }
 
-        // Merge the incoming data with the local data
-        data_t *merged = NULL;
-        if (rank < size/2) {
-            merged = merge(*local_data, 0, low_size, incoming_data, 0, new_size);
-            *local_size = low_size + new_size;
-            free(incoming_data);
-        } else {
-            merged = merge(incoming_data, 0, new_size, *local_data, mid, *local_size);
-            *local_size = high_size + new_size;
-            free(incoming_data);
+        // The incoming data and the kept partition are both sorted, so they are merged in
+        // linear time (split among the threads). The merge follows the exchange: as soon as
+        // a chunk arrives, the kept elements smaller than its last key are merged with it
+        // while the next chunks are still in flight
+        idx_t kept_merged = 0;
+        idx_t incoming_merged = 0;
+        for (int c = 0; c < exchange.recv_chunks; c++) {
+            idx_t received = MPI_Exchange_wait(&exchange, c);
+            idx_t kept_end = binary_search(kept, kept_merged, kept_size - 1, incoming_data[received - 1].data[HOT]);
+
+            data_t *runs[2] = {kept + kept_merged, incoming_data + incoming_merged};
+            idx_t run_sizes[2] = {kept_end - kept_merged, received - incoming_merged};
+
+            #pragma omp parallel
+            #pragma omp single
+            omp_multiway_merge(runs, run_sizes, 2, merged + kept_merged + incoming_merged, omp_get_num_threads());
+
+            kept_merged = kept_end;
+            incoming_merged = received;
         }
 
+        // The rest of the kept partition is not smaller than any of the incoming data
+        memcpy(merged + kept_merged + incoming_merged, kept + kept_merged, (kept_size - kept_merged) * sizeof(data_t));
+
+        MPI_Exchange_end(&exchange);
+        free(incoming_data);
+        free(kept_guest);
+
         // Free the initial local data and update the pointer to the new merged data
         free(*local_data);
         *local_data = merged;
 
-        // Define 2 new communicators for the recursive calls
-        MPI_Comm low_comm, high_comm;
-        MPI_Comm_split(comm, rank < size/2, rank, &low_comm);
-        MPI_Comm_split(comm, rank >= size/2, rank, &high_comm);
+        if (qsort_tuning.report)
+            MPI_Balance_report(level, *local_size, ranks, size, comm);
 
-        // Recursive calls
-        if (rank < size/2) {
+        // Recursive calls on the communicators of the next level of the hierarchy
+        if (rank < half) {
             // Low group processes sort the low partition
-            MPI_Hyperquicksort(local_data, local_size,
-                               low_processes, size/2,
-                               low_comm, MPI_DATA_T,
-                               cmp_ge);
+            hyperquicksort(local_data, local_size,
+                           ranks, half,
+                           cube, level + 1, MPI_DATA_T);
         } else {
             // High group processes sort the high partition
-            MPI_Hyperquicksort(local_data, local_size,
-                               high_processes, size/2, 
-                               high_comm, MPI_DATA_T,
-                               cmp_ge);
+            hyperquicksort(local_data, local_size,
+                           ranks + half, size - half,
+                           cube, level + 1, MPI_DATA_T);
         }
 
-        // Free memory
-        free(low_processes);
-        free(high_processes);
+    }
+}
 
-    } else { // If only one process is entering the recursive call we sort locally 
+// Hyperquicksort function (MPI)
+void MPI_Hyperquicksort(data_t **local_data, idx_t *local_size, 
+                        int *ranks, int size,
+                        MPI_Comm comm, MPI_Datatype MPI_DATA_T,
+                        compare_t cmp_ge) {
 
-        #pragma omp parallel
-        #pragma omp single
-        omp_task_qsort(*local_data, 0, *local_size, cmp_ge);
+    // Each process sorts its local data only once, the exchanges merge sorted data
+    #pragma omp parallel
+    #pragma omp single
+    omp_task_qsort(*local_data, 0, *local_size, cmp_ge);
 
-    }
+    // The communicators of the recursion are split only on the first call on comm
+    hyperquicksort(local_data, local_size, ranks, size, MPI_Hypercube(comm), 0, MPI_DATA_T);
 }
 
 #endif
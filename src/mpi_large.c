@@ -0,0 +1,227 @@
+#include "qsort.h"
+
+#if defined(MPI_VERSION) && defined(_OPENMP)
+
+// Collectives on data_t arrays with idx_t counts and displacements. The MPI-3
+// collectives take int counts and displacements, which limits a process to
+// INT_MAX elements (and the displacements of the root to INT_MAX elements of the
+// whole array). With MPI-4 the large count versions (_c) are called directly,
+// otherwise the standard collectives are used as long as all the counts and the
+// displacements fit in an int, and the data are moved with point-to-point
+// messages of at most LARGE_CHUNK elements when they do not
+
+// Elements per message of the point-to-point fallback
+#define LARGE_CHUNK ((idx_t)1 << 30)
+
+#if MPI_VERSION >= 4
+
+// Copies of the idx_t counts and displacements with the large count types
+static MPI_Count *to_count(idx_t *values, int n) {
+    if (values == NULL) { return NULL; }
+    MPI_Count *counts = (MPI_Count *)malloc(n * sizeof(MPI_Count));
+    for (int i = 0; i < n; i++)
+        counts[i] = values[i];
+    return counts;
+}
+
+static MPI_Aint *to_aint(idx_t *values, int n) {
+    if (values == NULL) { return NULL; }
+    MPI_Aint *displs = (MPI_Aint *)malloc(n * sizeof(MPI_Aint));
+    for (int i = 0; i < n; i++)
+        displs[i] = values[i];
+    return displs;
+}
+
+#else
+
+// Copies the n values into an int array (NULL if values is NULL) and returns
+// whether all of them fit in an int
+static int to_int(idx_t *values, int n, int **ints) {
+    *ints = NULL;
+    if (values == NULL) { return 1; }
+
+    int fit = 1;
+    *ints = (int *)malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        fit &= (values[i] <= INT_MAX);
+        (*ints)[i] = (int)values[i];
+    }
+    return fit;
+}
+
+// Number of messages needed to move count elements in LARGE_CHUNK pieces
+static inline int count_messages(idx_t count) {
+    return (int)((count + LARGE_CHUNK - 1) / LARGE_CHUNK);
+}
+
+// Posts the non-blocking sends (or receives) of buffer[0 ... count) with peer in
+// messages of at most LARGE_CHUNK elements, starting from requests[*n]
+static void post_messages(data_t *buffer, idx_t count, int peer, int receive,
+                          MPI_Comm comm, MPI_Datatype MPI_DATA_T,
+                          MPI_Request *requests, int *n) {
+    for (idx_t first = 0; first < count; first += LARGE_CHUNK) {
+        int size = (int)((count - first < LARGE_CHUNK) ? count - first : LARGE_CHUNK);
+        if (receive)
+            MPI_Irecv(buffer + first, size, MPI_DATA_T, peer, 0, comm, &requests[(*n)++]);
+        else
+            MPI_Isend(buffer + first, size, MPI_DATA_T, peer, 0, comm, &requests[(*n)++]);
+    }
+}
+
+#endif
+
+// MPI_Alltoallv() with idx_t counts and displacements
+void MPI_Alltoallv_large(data_t *send_data, idx_t *send_counts, idx_t *send_displs,
+                         data_t *recv_data, idx_t *recv_counts, idx_t *recv_displs,
+                         MPI_Comm comm, MPI_Datatype MPI_DATA_T) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+#if MPI_VERSION >= 4
+    MPI_Count *scounts = to_count(send_counts, size), *rcounts = to_count(recv_counts, size);
+    MPI_Aint *sdispls = to_aint(send_displs, size), *rdispls = to_aint(recv_displs, size);
+    MPI_Alltoallv_c(send_data, scounts, sdispls, MPI_DATA_T,
+                    recv_data, rcounts, rdispls, MPI_DATA_T, comm);
+    free(scounts);
+    free(rcounts);
+    free(sdispls);
+    free(rdispls);
+#else
+    int *scounts, *rcounts, *sdispls, *rdispls;
+    int fit = to_int(send_counts, size, &scounts) & to_int(recv_counts, size, &rcounts)
+            & to_int(send_displs, size, &sdispls) & to_int(recv_displs, size, &rdispls);
+    MPI_Allreduce(MPI_IN_PLACE, &fit, 1, MPI_INT, MPI_LAND, comm);
+
+    if (fit) {
+        MPI_Alltoallv(send_data, scounts, sdispls, MPI_DATA_T,
+                      recv_data, rcounts, rdispls, MPI_DATA_T, comm);
+    } else {
+        int messages = 0, n = 0;
+        for (int i = 0; i < size; i++)
+            if (i != rank)
+                messages += count_messages(send_counts[i]) + count_messages(recv_counts[i]);
+
+        MPI_Request *requests = (MPI_Request *)malloc(messages * sizeof(MPI_Request));
+        for (int i = 0; i < size; i++)
+            if (i != rank)
+                post_messages(recv_data + recv_displs[i], recv_counts[i], i, 1, comm, MPI_DATA_T, requests, &n);
+        for (int i = 0; i < size; i++)
+            if (i != rank)
+                post_messages(send_data + send_displs[i], send_counts[i], i, 0, comm, MPI_DATA_T, requests, &n);
+
+        // The data of the process itself are just copied
+        memcpy(recv_data + recv_displs[rank], send_data + send_displs[rank], send_counts[rank] * sizeof(data_t));
+
+        MPI_Waitall(n, requests, MPI_STATUSES_IGNORE);
+        free(requests);
+    }
+
+    free(scounts);
+    free(rcounts);
+    free(sdispls);
+    free(rdispls);
+#endif
+}
+
+// MPI_Scatterv() with idx_t counts and displacements (significant only on root)
+void MPI_Scatterv_large(data_t *send_data, idx_t *send_counts, idx_t *send_displs,
+                        data_t *recv_data, idx_t recv_count, int root,
+                        MPI_Comm comm, MPI_Datatype MPI_DATA_T) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+#if MPI_VERSION >= 4
+    MPI_Count *scounts = to_count(send_counts, size);
+    MPI_Aint *sdispls = to_aint(send_displs, size);
+    MPI_Scatterv_c(send_data, scounts, sdispls, MPI_DATA_T,
+                   recv_data, recv_count, MPI_DATA_T, root, comm);
+    free(scounts);
+    free(sdispls);
+#else
+    int *scounts, *sdispls;
+    int fit = to_int(send_counts, size, &scounts) & to_int(send_displs, size, &sdispls);
+    MPI_Bcast(&fit, 1, MPI_INT, root, comm);
+
+    if (fit) {
+        MPI_Scatterv(send_data, scounts, sdispls, MPI_DATA_T,
+                     recv_data, (int)recv_count, MPI_DATA_T, root, comm);
+    } else if (rank == root) {
+        int messages = 0, n = 0;
+        for (int i = 0; i < size; i++)
+            if (i != root)
+                messages += count_messages(send_counts[i]);
+
+        MPI_Request *requests = (MPI_Request *)malloc(messages * sizeof(MPI_Request));
+        for (int i = 0; i < size; i++)
+            if (i != root)
+                post_messages(send_data + send_displs[i], send_counts[i], i, 0, comm, MPI_DATA_T, requests, &n);
+        memcpy(recv_data, send_data + send_displs[root], recv_count * sizeof(data_t));
+
+        MPI_Waitall(n, requests, MPI_STATUSES_IGNORE);
+        free(requests);
+    } else {
+        int n = 0;
+        MPI_Request *requests = (MPI_Request *)malloc(count_messages(recv_count) * sizeof(MPI_Request));
+        post_messages(recv_data, recv_count, root, 1, comm, MPI_DATA_T, requests, &n);
+        MPI_Waitall(n, requests, MPI_STATUSES_IGNORE);
+        free(requests);
+    }
+
+    free(scounts);
+    free(sdispls);
+#endif
+}
+
+// MPI_Gatherv() with idx_t counts and displacements (significant only on root)
+void MPI_Gatherv_large(data_t *send_data, idx_t send_count,
+                       data_t *recv_data, idx_t *recv_counts, idx_t *recv_displs, int root,
+                       MPI_Comm comm, MPI_Datatype MPI_DATA_T) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+#if MPI_VERSION >= 4
+    MPI_Count *rcounts = to_count(recv_counts, size);
+    MPI_Aint *rdispls = to_aint(recv_displs, size);
+    MPI_Gatherv_c(send_data, send_count, MPI_DATA_T,
+                  recv_data, rcounts, rdispls, MPI_DATA_T, root, comm);
+    free(rcounts);
+    free(rdispls);
+#else
+    int *rcounts, *rdispls;
+    int fit = to_int(recv_counts, size, &rcounts) & to_int(recv_displs, size, &rdispls);
+    MPI_Bcast(&fit, 1, MPI_INT, root, comm);
+
+    if (fit) {
+        MPI_Gatherv(send_data, (int)send_count, MPI_DATA_T,
+                    recv_data, rcounts, rdispls, MPI_DATA_T, root, comm);
+    } else if (rank == root) {
+        int messages = 0, n = 0;
+        for (int i = 0; i < size; i++)
+            if (i != root)
+                messages += count_messages(recv_counts[i]);
+
+        MPI_Request *requests = (MPI_Request *)malloc(messages * sizeof(MPI_Request));
+        for (int i = 0; i < size; i++)
+            if (i != root)
+                post_messages(recv_data + recv_displs[i], recv_counts[i], i, 1, comm, MPI_DATA_T, requests, &n);
+        memcpy(recv_data + recv_displs[root], send_data, send_count * sizeof(data_t));
+
+        MPI_Waitall(n, requests, MPI_STATUSES_IGNORE);
+        free(requests);
+    } else {
+        int n = 0;
+        MPI_Request *requests = (MPI_Request *)malloc(count_messages(send_count) * sizeof(MPI_Request));
+        post_messages(send_data, send_count, root, 0, comm, MPI_DATA_T, requests, &n);
+        MPI_Waitall(n, requests, MPI_STATUSES_IGNORE);
+        free(requests);
+    }
+
+    free(rcounts);
+    free(rdispls);
+#endif
+}
+
+#endif
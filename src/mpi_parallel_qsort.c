@@ -2,123 +2,109 @@
 
 #if defined(MPI_VERSION) && defined(_OPENMP)
 
-// Parallel quicksort function (MPI)
-void MPI_Parallel_qsort(data_t **local_data, int *local_size, 
-                        int *ranks, int size,
-                        MPI_Comm comm, MPI_Datatype MPI_DATA_T,
-                        compare_t cmp_ge) {
+// Recursive step of the parallel quicksort (MPI) at the given level of the hierarchy
+static void parallel_qsort(data_t **local_data, idx_t *local_size,
+                           int *ranks, int size,
+                           hypercube_t *cube, int level, MPI_Datatype MPI_DATA_T,
+                           compare_t cmp_ge) {
 
     if (size > 1) {
 
-        if(size % 2 != 0) {
-            fprintf(stdout, "ERROR: Odd number of processes in MPI_Parallel_qsort.\n");
-            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-        }
-
-        // Divide the processes in the communicator in 2 groups
+        // The processes in the communicator of this level are divided in 2 groups: the
+        // low one (rank < half) and the high one (rank >= half). With an odd number of
+        // processes the last one has no partner in the low group: it sends its "low"
+        // partition to the last process of the low group (the host) and keeps the rest
+        MPI_Comm comm = cube->comms[level];
         int rank; // rank in the recursive call
         MPI_Comm_rank(comm, &rank);
-        int *low_processes  = (int *)malloc((size/2) * sizeof(int));
-        int *high_processes = (int *)malloc((size/2) * sizeof(int));
-        for (int i = 0; i < size/2; i++) {
-            low_processes[i]  = ranks[i];          // rank <  size/2
-            high_processes[i] = ranks[i + size/2]; // rank >= size/2
-        }
+        int half = size/2;
+        int unpaired = (size % 2 != 0 && rank == size - 1);
+        int partner  = (rank < half) ? rank + half : (unpaired ? MPI_PROC_NULL : rank - half);
+        int host     = unpaired ? half - 1 : MPI_PROC_NULL;
+        int guest    = (size % 2 != 0 && rank == half - 1) ? size - 1 : MPI_PROC_NULL;
 
-        // Master process picks median pivot in its chunk and broadcasts it
-        double pivot = 0;
-        if (rank == 0) {
-            double a = (*local_data)[0].data[HOT];
-            double b = (*local_data)[(*local_size)/2].data[HOT];
-            double c = (*local_data)[*local_size-1].data[HOT];
-            pivot = a < b ? (b < c ? b : (a < c ? c : a)) 
-                    : (a < c ? a : (b < c ? c : b));       
-        }
-        MPI_Bcast(&pivot, 1, MPI_DOUBLE, 0, comm);
+        // The pivot leaves to the low group a share of the data proportional to its
+        // number of processes
+        double pivot = MPI_Pivot(*local_data, *local_size, 0, (double)half / size, comm);
 
         // Each process partitions its chunk according to the pivot
-        int mid = partitioning_low_high(*local_data, 0, *local_size, pivot);
+        idx_t mid = partitioning_low_high(*local_data, 0, *local_size, pivot);
 
         // Each process in the low group sends the size of its "high" partition (from mid included to end excluded)
         // to one process of the high group and receives from it the size of the "low" partition (from start included
-        // to mid excluded) in a sendrecv operation
-        int new_size  = 0;
-        int low_size  = mid;
-        int high_size = *local_size - mid;
-
-        if (rank < size/2) {
-            MPI_Sendrecv(&high_size,    1,   MPI_INT,        // adress send buffer, count send elements, type of send elements
-                         rank + size/2, 0,                   // rank of the process to send to, tag
-                         &new_size,     1,   MPI_INT,        // adress receive buffer, count receive elements, type of receive elements
-                         rank + size/2, 0,                   // rank of the process to receive from, tag
+        // to mid excluded) in a sendrecv operation. The unpaired process sends the size of its "low" partition to
+        // the host (send and receive with MPI_PROC_NULL do nothing)
+        idx_t new_size   = 0;
+        idx_t guest_size = 0;
+        idx_t low_size   = mid;
+        idx_t high_size  = *local_size - mid;
+
+        if (rank < half) {
+            MPI_Sendrecv(&high_size,    1,   MPI_IDX_T,      // adress send buffer, count send elements, type of send elements
+                         partner,       0,                   // rank of the process to send to, tag
+                         &new_size,     1,   MPI_IDX_T,      // adress receive buffer, count receive elements, type of receive elements
+                         partner,       0,                   // rank of the process to receive from, tag
                          comm, MPI_STATUS_IGNORE);           // communicator, status
+            MPI_Recv(&guest_size, 1, MPI_IDX_T, guest, 0, comm, MPI_STATUS_IGNORE);
         } else {
-            MPI_Sendrecv(&low_size,    1,   MPI_INT,         // adress send buffer, count send elements, type of send elements
-                         rank - size/2, 0,                   // rank of the process to send to, tag
-                         &new_size,     1,   MPI_INT,        // adress receive buffer, count receive elements, type of receive elements
-                         rank - size/2, 0,                   // rank of the process to receive from, tag
+            MPI_Sendrecv(&low_size,     1,   MPI_IDX_T,      // adress send buffer, count send elements, type of send elements
+                         unpaired ? host : partner, 0,       // rank of the process to send to, tag
+                         &new_size,     1,   MPI_IDX_T,      // adress receive buffer, count receive elements, type of receive elements
+                         partner,       0,                   // rank of the process to receive from, tag
                          comm, MPI_STATUS_IGNORE);           // communicator, status
         }
 
-        // Allocate memory for the incoming data
-        data_t *incoming_data = (data_t *)malloc(new_size * sizeof(data_t));
-
-        // Each process of the low group send its "high" partition to one process of the high group
-        // and receives the "low" partition from that same other process in a sendrecv operation
-        if (rank < size/2) {
-            MPI_Sendrecv(&(*local_data)[mid], high_size, MPI_DATA_T,
-                         rank + size/2, 0,
-                         incoming_data, new_size, MPI_DATA_T,
-                         rank + size/2, 0,
-                         comm, MPI_STATUS_IGNORE);
+        // Allocate memory for the new local data, made of the kept partition and the incoming ones
+        *local_size = (rank < half) ? low_size + new_size + guest_size : high_size + new_size;
+        data_t *merged = (data_t *)malloc(*local_size * sizeof(data_t));
+
+        // Each process of the low group sends its "high" partition to one process of the high group
+        // and receives the "low" partition from that same other process (and from the unpaired one
+        // for the host). The partitions travel in chunks that are received directly at their final
+        // place in the new local data, while the kept partition is copied there
+        exchange_t exchange, guest_exchange;
+        if (rank < half) {
+            MPI_Exchange_start(&exchange,
+                               &(*local_data)[mid], high_size, partner,     // send the high partition
+                               &merged[low_size], new_size, partner,        // receive after the kept partition
+                               comm, MPI_DATA_T);
+            MPI_Exchange_start(&guest_exchange,
+                               NULL, 0, MPI_PROC_NULL,
+                               &merged[low_size + new_size], guest_size, guest, // receive at the end
+                               comm, MPI_DATA_T);
+            memcpy(merged, *local_data, low_size * sizeof(data_t));
+            MPI_Exchange_end(&guest_exchange);
         } else {
-            MPI_Sendrecv(&(*local_data)[0], low_size, MPI_DATA_T,
-                         rank - size/2, 0,
-                         incoming_data, new_size, MPI_DATA_T,
-                         rank - size/2, 0,
-                         comm, MPI_STATUS_IGNORE);
-        }
-
-        // Merge the incoming data with the local data
-        data_t *merged = NULL;
-        if (rank < size/2) {
-            merged = merge(*local_data, 0, low_size, incoming_data, 0, new_size);
-            *local_size = low_size + new_size;
-            free(incoming_data);
-        } else {
-            merged = merge(incoming_data, 0, new_size, *local_data, mid, *local_size);
-            *local_size = high_size + new_size;
-            free(incoming_data);
+            MPI_Exchange_start(&exchange,
+                               &(*local_data)[0], low_size, unpaired ? host : partner, // send the low partition
+                               &merged[0], new_size, partner,               // receive before the kept partition
+                               comm, MPI_DATA_T);
+            memcpy(&merged[new_size], &(*local_data)[mid], high_size * sizeof(data_t));
         }
+        MPI_Exchange_end(&exchange);
 
         // Free the initial local data and update the pointer to the new merged data
         free(*local_data);
         *local_data = merged;
 
-        // Define 2 new communicators for the recursive calls
-        MPI_Comm low_comm, high_comm;
-        MPI_Comm_split(comm, rank < size/2, rank, &low_comm);
-        MPI_Comm_split(comm, rank >= size/2, rank, &high_comm);
+        if (qsort_tuning.report)
+            MPI_Balance_report(level, *local_size, ranks, size, comm);
 
-        // Recursive calls
-        if (rank < size/2) {
+        // Recursive calls on the communicators of the next level of the hierarchy
+        if (rank < half) {
             // Low group processes sort the low partition
-            MPI_Parallel_qsort(local_data, local_size,
-                               low_processes, size/2,
-                               low_comm, MPI_DATA_T,
-                               cmp_ge);
+            parallel_qsort(local_data, local_size,
+                           ranks, half,
+                           cube, level + 1, MPI_DATA_T,
+                           cmp_ge);
         } else {
             // High group processes sort the high partition
-            MPI_Parallel_qsort(local_data, local_size,
-                               high_processes, size/2, 
-                               high_comm, MPI_DATA_T,
-                               cmp_ge);
+            parallel_qsort(local_data, local_size,
+                           ranks + half, size - half,
+                           cube, level + 1, MPI_DATA_T,
+                           cmp_ge);
         }
 
-        // Free memory
-        free(low_processes);
-        free(high_processes);
-
     } else { // If only one process is entering the recursive call we sort locally 
 
         #pragma omp parallel
@@ -128,4 +114,17 @@ void MPI_Parallel_qsort(data_t **local_data, int *local_size,
     }
 }
 
+// Parallel quicksort function (MPI)
+void MPI_Parallel_qsort(data_t **local_data, idx_t *local_size, 
+                        int *ranks, int size,
+                        MPI_Comm comm, MPI_Datatype MPI_DATA_T,
+                        compare_t cmp_ge) {
+
+    // The communicators of the recursion are split only on the first call on comm
+    parallel_qsort(local_data, local_size,
+                   ranks, size,
+                   MPI_Hypercube(comm), 0, MPI_DATA_T,
+                   cmp_ge);
+}
+
 #endif
@@ -0,0 +1,110 @@
+#include "qsort.h"
+
+#if defined(MPI_VERSION) && defined(_OPENMP)
+
+// Sample element of the global sample, weighted by the number of local elements
+// it represents
+typedef struct {
+    double key;
+    double weight;
+} weighted_sample_t;
+
+static int compare_weighted_sample(const void *a, const void *b) {
+    double diff = ((weighted_sample_t *)a)->key - ((weighted_sample_t *)b)->key;
+    return ((diff > 0) - (diff < 0));
+}
+
+// Pivot that leaves a fraction f of the n elements of data before it, estimated on
+// PIVOT_SAMPLES elements taken at regular intervals from the first to the last one
+static double quantile_pivot(data_t *data, idx_t n, double f) {
+    if (n == 0) { return 0; }
+
+    int count = (n < PIVOT_SAMPLES) ? (int)n : PIVOT_SAMPLES;
+    double samples[PIVOT_SAMPLES];
+    for (int i = 0; i < count; i++) {
+        idx_t index = (count > 1) ? i * (n - 1) / (count - 1) : 0;
+        samples[i] = data[index].data[HOT];
+    }
+    qsort(samples, count, sizeof(double), compare_double);
+
+    return samples[(int)(f * (count - 1) + 0.5)];
+}
+
+// Pivot of the recursive MPI sorts that leaves a fraction f of the data of all the
+// processes of comm before it. With qsort_tuning.pivot == PIVOT_ROOT the first
+// process chooses it on its own data (exactly if sorted is set, otherwise on a
+// sample) and broadcasts it. With PIVOT_SAMPLE every process contributes
+// PIVOT_SAMPLES elements of its data, each weighted by the number of elements it
+// represents, and all the processes compute the same weighted quantile of the
+// gathered sample, so that the groups stay balanced even with skewed data
+double MPI_Pivot(data_t *data, idx_t n, int sorted, double f, MPI_Comm comm) {
+
+    double pivot = 0;
+
+    if (qsort_tuning.pivot == PIVOT_ROOT) {
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        if (rank == 0 && n > 0)
+            pivot = sorted ? data[(idx_t)(n * f)].data[HOT] : quantile_pivot(data, n, f);
+        MPI_Bcast(&pivot, 1, MPI_DOUBLE, 0, comm);
+        return pivot;
+    }
+
+    int size;
+    MPI_Comm_size(comm, &size);
+
+    // Local sample at regular intervals (the unused entries have no weight)
+    weighted_sample_t local_samples[PIVOT_SAMPLES];
+    int count = (n < PIVOT_SAMPLES) ? (int)n : PIVOT_SAMPLES;
+    for (int i = 0; i < PIVOT_SAMPLES; i++) {
+        if (i < count) {
+            local_samples[i].key = data[(2 * i + 1) * n / (2 * count)].data[HOT];
+            local_samples[i].weight = (double)n / count;
+        } else {
+            local_samples[i].key = 0;
+            local_samples[i].weight = 0;
+        }
+    }
+
+    weighted_sample_t *samples = (weighted_sample_t *)malloc(size * PIVOT_SAMPLES * sizeof(weighted_sample_t));
+    MPI_Allgather(local_samples, 2 * PIVOT_SAMPLES, MPI_DOUBLE,
+                  samples, 2 * PIVOT_SAMPLES, MPI_DOUBLE, comm);
+
+    // Weighted quantile of the global sample
+    qsort(samples, size * PIVOT_SAMPLES, sizeof(weighted_sample_t), compare_weighted_sample);
+
+    double total = 0;
+    for (int i = 0; i < size * PIVOT_SAMPLES; i++)
+        total += samples[i].weight;
+
+    double cumulative = 0;
+    for (int i = 0; i < size * PIVOT_SAMPLES; i++) {
+        if (samples[i].weight == 0) { continue; }
+        pivot = samples[i].key;
+        cumulative += samples[i].weight;
+        if (cumulative > f * total) { break; }
+    }
+
+    free(samples);
+    return pivot;
+}
+
+// Prints (on the first process of comm) the load balance of the processes of comm,
+// which are ranks[0 ... size) in the world communicator, after a recursion level
+void MPI_Balance_report(int level, idx_t local_size, int *ranks, int size, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    idx_t max_size = 0, total = 0;
+    MPI_Reduce(&local_size, &max_size, 1, MPI_IDX_T, MPI_MAX, 0, comm);
+    MPI_Reduce(&local_size, &total, 1, MPI_IDX_T, MPI_SUM, 0, comm);
+
+    if (rank == 0) {
+        double average = (double)total / size;
+        fprintf(stdout, "Level %d, processes %d-%d: max %lld, average %.1f, imbalance %.3f\n",
+                level, ranks[0], ranks[size - 1], (long long int)max_size, average,
+                (average > 0) ? max_size / average : 1.0);
+    }
+}
+
+#endif
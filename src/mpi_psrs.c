@@ -2,75 +2,240 @@
 
 #if defined(_OPENMP) && defined(MPI_VERSION)
 
-// Parallel Sort by Regular Sampling (PSRS) function (MPI)
-void MPI_PSRS(data_t **local_data, int *local_size,
-              int global_size, int rank, int size,
-              MPI_Datatype MPI_DATA_T,
-              compare_t cmp_ge) {
+// Merges the sorted arrays of samples of all the processes along a binomial tree:
+// at step k the processes with rank multiple of 2k receive the samples of the process
+// at distance k and merge them with their own. In the end the root process owns all
+// the samples (sorted) while the others own none
+static void merge_samples_tree(double **samples, int *samples_size, int rank, int size, MPI_Comm comm) {
+    for (int step = 1; step < size; step *= 2) {
+        if (rank % (2 * step) != 0) {
+            MPI_Send(*samples, *samples_size, MPI_DOUBLE, rank - step, 0, comm);
+            free(*samples);
+            *samples = NULL;
+            *samples_size = 0;
+            return;
+        }
+        if (rank + step >= size) { continue; }
 
-    // Each process sorts its local data
-    #pragma omp parallel
-    #pragma omp single
-    omp_task_qsort(*local_data, 0, *local_size, cmp_ge);
+        // Receive the samples of the partner, whose number is not known in advance
+        MPI_Status status;
+        int incoming_size;
+        MPI_Probe(rank + step, 0, comm, &status);
+        MPI_Get_count(&status, MPI_DOUBLE, &incoming_size);
+        double *incoming = (double *)malloc(incoming_size * sizeof(double));
+        MPI_Recv(incoming, incoming_size, MPI_DOUBLE, rank + step, 0, comm, MPI_STATUS_IGNORE);
 
-    // Just check in case there is only 1 process
-    if (size == 1) { return; }
+        // Linear merge of the two sorted arrays
+        double *merged = (double *)malloc((*samples_size + incoming_size) * sizeof(double));
+        int i = 0, j = 0, k = 0;
+        while (i < *samples_size && j < incoming_size)
+            merged[k++] = ((*samples)[i] <= incoming[j]) ? (*samples)[i++] : incoming[j++];
+        while (i < *samples_size)
+            merged[k++] = (*samples)[i++];
+        while (j < incoming_size)
+            merged[k++] = incoming[j++];
 
-    // Each process samples its local data
-    double *local_samples = (double *)malloc(size * sizeof(double));
-    int step = (global_size) / (size * size);
-    #pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        local_samples[i] = (*local_data)[i * step].data[HOT];
-    }    
+        free(*samples);
+        free(incoming);
+        *samples = merged;
+        *samples_size = k;
+    }
+}
 
-    // Gather all the samples in the root process
-    double *samples = NULL;
-    if (rank == 0)
-        samples = (double *)malloc(size * size * sizeof(double));
-    
-    MPI_Gather(local_samples, size, MPI_DOUBLE,
-               samples, size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    free(local_samples);
+// Inverse of radix_key(): the double whose radix key is key
+static inline double radix_value(uint64_t key) {
+    uint64_t bits = key ^ ((key >> 63) ? (uint64_t)1 << 63 : ~(uint64_t)0);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
 
-    // The root process sorts the samples and selects the pivots
-    double *pivots = (double *)malloc((size - 1) * sizeof(double));
-    if (rank == 0) {
-        qsort(samples, size * size, sizeof(double), compare_double);
+// Refines the size-1 pivots of the PSRS algorithm on the sorted local data of the
+// processes of comm (global_size elements in total) until the largest partition
+// is within (1+epsilon)*global_size/size. Each pivot keeps the bracket of the two
+// nearest keys around its target rank (a multiple of global_size/size) among the
+// keys whose global rank is known, and each round proposes one new key inside each
+// bracket that can still be narrowed, alternating interpolation and bisection on
+// the radix keys. All the processes compute the same keys, so a round costs a
+// single allreduce of at most size-1 ranks, whatever the oversampling
+static void refine_splitters(data_t *local_data, idx_t local_size, idx_t global_size,
+                             int size, MPI_Comm comm, double *pivots) {
+
+    // Global minimum and maximum keys: the minimum (of rank 0) is the first lower
+    // bound of all the brackets and the maximum is a candidate of the first round
+    double bounds[2] = {-INFINITY, -INFINITY};
+    if (local_size > 0) {
+        bounds[0] = -local_data[0].data[HOT];
+        bounds[1] = local_data[local_size - 1].data[HOT];
+    }
+    MPI_Allreduce(MPI_IN_PLACE, bounds, 2, MPI_DOUBLE, MPI_MAX, comm);
+
+    // Brackets of the pivots (an upper bound with negative rank is not known yet)
+    int m = size - 1;
+    double *lo = (double *)malloc(m * sizeof(double));
+    double *hi = (double *)malloc(m * sizeof(double));
+    idx_t *lo_rank = (idx_t *)malloc(m * sizeof(idx_t));
+    idx_t *hi_rank = (idx_t *)malloc(m * sizeof(idx_t));
+    double *candidates = (double *)malloc(size * sizeof(double));
+    idx_t *ranks = (idx_t *)malloc(size * sizeof(idx_t));
+    double *inner = (double *)malloc(2 * m * sizeof(double));
+    for (int i = 0; i < m; i++) {
+        lo[i] = -bounds[0];
+        lo_rank[i] = 0;
+        hi_rank[i] = -1;
+        candidates[i] = pivots[i];
+    }
+    candidates[m] = bounds[1];
+    int c = size;
+
+    for (int round = 0; ; round++) {
+
+        // Global ranks of the candidates (sorted, so that their ranks are non-decreasing)
+        qsort(candidates, c, sizeof(double), compare_double);
+        #pragma omp parallel for
+        for (int j = 0; j < c; j++)
+            ranks[j] = binary_search(local_data, 0, local_size - 1, candidates[j]);
+        MPI_Allreduce(MPI_IN_PLACE, ranks, c, MPI_IDX_T, MPI_SUM, comm);
+
+        // The candidates narrow the brackets around the targets, and each pivot is the
+        // bound of its bracket with the nearest rank to the target (not smaller than
+        // the previous pivot)
+        idx_t max_bucket = 0, previous = 0;
+        for (int i = 0, j = 0; i < m; i++) {
+            idx_t target = (i + 1) * global_size / size;
+            while (j < c && ranks[j] <= target)
+                j++;
+            if (j > 0 && candidates[j-1] > lo[i]) {
+                lo[i] = candidates[j-1];
+                lo_rank[i] = ranks[j-1];
+            }
+            if (j < c && (hi_rank[i] < 0 || candidates[j] < hi[i])) {
+                hi[i] = candidates[j];
+                hi_rank[i] = ranks[j];
+            }
+
+            int upper = hi_rank[i] >= 0 && hi_rank[i] - target < target - lo_rank[i];
+            pivots[i] = upper ? hi[i] : lo[i];
+            idx_t pivot_rank = upper ? hi_rank[i] : lo_rank[i];
+            if (i > 0 && pivots[i] < pivots[i-1]) {
+                pivots[i] = pivots[i-1];
+                pivot_rank = previous;
+            }
+            if (pivot_rank - previous > max_bucket)
+                max_bucket = pivot_rank - previous;
+            previous = pivot_rank;
+        }
+        if (global_size - previous > max_bucket)
+            max_bucket = global_size - previous;
+
+        if (max_bucket <= (1 + qsort_tuning.epsilon) * global_size / size)
+            break;
+
+        // Nearest keys of the data inside each bracket: the smallest one above the lower
+        // bound and the largest one below the upper bound (the other keys have the same
+        // ranks as these). They are reduced as the maximum of their opposite and of the
+        // key itself, so an empty bracket ends with a first key above its last one
         #pragma omp parallel for
-        for (int i = 0; i < size - 1; i++)
-            pivots[i] = samples[(i + 1) * size];
+        for (int i = 0; i < m; i++) {
+            inner[2*i] = inner[2*i+1] = -INFINITY;
+            if (hi_rank[i] < 0) { continue; }
+            idx_t first = binary_search(local_data, 0, local_size - 1, radix_value(radix_key(lo[i]) + 1));
+            idx_t last = binary_search(local_data, 0, local_size - 1, hi[i]) - 1;
+            if (first <= last) {
+                inner[2*i] = -local_data[first].data[HOT];
+                inner[2*i+1] = local_data[last].data[HOT];
+            }
+        }
+        MPI_Allreduce(MPI_IN_PLACE, inner, 2 * m, MPI_DOUBLE, MPI_MAX, comm);
+
+        // New candidates between the inner keys of the brackets that are not converged,
+        // i.e. whose lower bound is not exactly at the target and that hold some data:
+        // each round excludes at least one distinct key from each of these brackets
+        c = 0;
+        for (int i = 0; i < m; i++) {
+            idx_t target = (i + 1) * global_size / size;
+            if (hi_rank[i] < 0 || lo_rank[i] == target || -inner[2*i] > inner[2*i+1]) { continue; }
+            uint64_t low = radix_key(-inner[2*i]), gap = radix_key(inner[2*i+1]) - low;
+
+            uint64_t step = gap / 2;
+            if (round % 2 == 0)
+                step = (uint64_t)((long double)gap * (target - lo_rank[i]) / (hi_rank[i] - lo_rank[i]));
+
+            double candidate = radix_value(low + step);
+            if (c == 0 || candidate != candidates[c-1])
+                candidates[c++] = candidate;
+        }
+        if (c == 0) { break; }
     }
 
-    // Broadcast the pivots to all the processes
-    MPI_Bcast(pivots, size - 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    // Freeing memory
+    free(lo);
+    free(hi);
+    free(lo_rank);
+    free(hi_rank);
+    free(candidates);
+    free(ranks);
+    free(inner);
+}
+
+// Steps of the PSRS algorithm after the local sort, on the size processes of comm
+// whose local data are already sorted (global_size elements in total). Each
+// process ends with its sorted partition, in the order of the ranks in comm
+static void psrs(data_t **local_data, idx_t *local_size,
+                 idx_t global_size, int rank, int size, MPI_Comm comm,
+                 MPI_Datatype MPI_DATA_T) {
+
+    // Just check in case there is only 1 process
+    if (size == 1) { return; }
+
+    // Each process takes a regular sample of its sorted local data of size times the
+    // oversampling factor elements (none if it has no data)
+    int s = qsort_tuning.oversampling * size;
+    int samples_size = (*local_size > 0) ? s : 0;
+    double *samples = (double *)malloc(samples_size * sizeof(double));
+    if (samples_size > 0)
+        regular_sample(*local_data, 0, *local_size, s, samples);
+
+    // The samples of each process are already sorted: they are merged along a
+    // binomial tree, so that the root process receives all of them sorted without
+    // sorting anything and the merging work is spread over the processes
+    merge_samples_tree(&samples, &samples_size, rank, size, comm);
+
+    // The root process selects the pivots at regular positions of the samples and
+    // broadcasts them to all the processes, which refine them if requested
+    double *pivots = (double *)malloc((size - 1) * sizeof(double));
     if (rank == 0)
-        free(samples);
+        select_splitters(samples, NULL, samples_size, size, global_size, pivots);
+    MPI_Bcast(pivots, size - 1, MPI_DOUBLE, 0, comm);
+    free(samples);
+
+    if (qsort_tuning.epsilon > 0 && global_size > 0)
+        refine_splitters(*local_data, *local_size, global_size, size, comm, pivots);
 
     // Each process partitions its chunk in p parts using the pivots
-    int *local_mids = p_partitioning(*local_data, 0, *local_size, pivots, size - 1);
+    idx_t *local_mids = p_partitioning(*local_data, 0, *local_size, pivots, size - 1);
 
     // Each process measures the size of each partition
-    int *local_partitions_counts = (int *)malloc(size * sizeof(int)); // Sizes of the local partitions
+    idx_t *local_partitions_counts = (idx_t *)malloc(size * sizeof(idx_t)); // Sizes of the local partitions
     #pragma omp parallel for
     for (int i = 0; i < size-1; i++)
         local_partitions_counts[i] = local_mids[i+1] - local_mids[i];
     local_partitions_counts[size-1] = *local_size - local_mids[size-1];
 
     // Each process sends and receives from the others the sizes of the partition
-    int *counts = (int *)malloc(size * sizeof(int));    // Sizes of the partitions from the alltoall
-    MPI_Alltoall(local_partitions_counts, 1, MPI_INT,   // Send buffer, number of elements to send, send data type
-                 counts, 1, MPI_INT,                    // Receive buffer, number of elements to receive, receive data type
-                 MPI_COMM_WORLD);                       // Communicator
+    idx_t *counts = (idx_t *)malloc(size * sizeof(idx_t));  // Sizes of the partitions from the alltoall
+    MPI_Alltoall(local_partitions_counts, 1, MPI_IDX_T,     // Send buffer, number of elements to send, send data type
+                 counts, 1, MPI_IDX_T,                      // Receive buffer, number of elements to receive, receive data type
+                 comm);                                     // Communicator
 
     // Each process computes the rcvdispls for the alltoallv from the counts received
-    int *rcvdispls = (int *)malloc(size * sizeof(int)); // Displacements for the alltoallv from the alltoall
+    idx_t *rcvdispls = (idx_t *)malloc(size * sizeof(idx_t)); // Displacements for the alltoallv from the alltoall
     rcvdispls[0] = 0;
     for (int i = 1; i < size; i++)
         rcvdispls[i] = rcvdispls[i-1] + counts[i-1];
 
     // Each process computes how many elements it's going to be storing based on the counts
-    int local_sorted_size = 0;
+    idx_t local_sorted_size = 0;
     #pragma omp parallel for reduction(+:local_sorted_size)
     for (int i = 0; i < size; i++)
         local_sorted_size += counts[i];
@@ -78,25 +243,60 @@ void MPI_PSRS(data_t **local_data, int *local_size,
     *local_size = local_sorted_size;
 
     // Each process sends and receives the elements of the partitions in a alltoallv operation
+    // (with 64-bit counts and displacements)
+    data_t *received_data = (data_t *)malloc((local_sorted_size) * sizeof(data_t));
+    MPI_Alltoallv_large(*local_data, local_partitions_counts, local_mids,   // Send buffer, number of elements to send, displacements
+                        received_data, counts, rcvdispls,                   // Receive buffer, number of elements to receive, displacements
+                        comm, MPI_DATA_T);                                  // Communicator, data type
+
+    // The received data are made of size runs, already sorted by the sender, which
+    // are merged (instead of sorted again) by the threads into the sorted_data array
+    data_t **runs = (data_t **)malloc(size * sizeof(data_t *));
+    for (int i = 0; i < size; i++)
+        runs[i] = received_data + rcvdispls[i];
+
     data_t *sorted_data = (data_t *)malloc((local_sorted_size) * sizeof(data_t));
-    MPI_Alltoallv(*local_data, local_partitions_counts, local_mids, MPI_DATA_T, // Send buffer, number of elements to send, displacements, send data type
-                  sorted_data, counts, rcvdispls, MPI_DATA_T,                   // Receive buffer, number of elements to receive, displacements, receive data type
-                  MPI_COMM_WORLD);                                              // Communicator
-    
+    #pragma omp parallel
+    #pragma omp single
+    omp_multiway_merge(runs, counts, size, sorted_data, omp_get_num_threads());
+
     // Free the orirginal local_data and assign the sorted_data to it
     free(*local_data);
+    free(received_data);
+    free(runs);
     *local_data = sorted_data;
 
-    // Each process sorts the received data
-    #pragma omp parallel
-    #pragma omp single
-    omp_task_qsort(*local_data, 0, *local_size, cmp_ge);
-
     // Freeing memory
+    free(pivots);
     free(local_mids);
     free(local_partitions_counts);
     free(counts);
     free(rcvdispls);
 }
 
+// Parallel Sort by Regular Sampling (PSRS) function (MPI)
+void MPI_PSRS(data_t **local_data, idx_t *local_size,
+              idx_t global_size, int rank, int size,
+              MPI_Datatype MPI_DATA_T,
+              compare_t cmp_ge) {
+
+    // Each process sorts its local data
+    #pragma omp parallel
+    #pragma omp single
+    omp_task_qsort(*local_data, 0, *local_size, cmp_ge);
+
+    psrs(local_data, local_size, global_size, rank, size, MPI_COMM_WORLD, MPI_DATA_T);
+}
+
+// PSRS on already sorted local data and on any communicator (MPI)
+void MPI_PSRS_sorted(data_t **local_data, idx_t *local_size,
+                     idx_t global_size, MPI_Comm comm,
+                     MPI_Datatype MPI_DATA_T) {
+
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    psrs(local_data, local_size, global_size, rank, size, comm, MPI_DATA_T);
+}
+
 #endif
@@ -0,0 +1,148 @@
+#include "qsort.h"
+
+#if defined(_OPENMP) && defined(MPI_VERSION)
+
+// Radix sort function (MPI): the global histogram of the highest RADIX_SPLIT_BITS
+// bits that differ among the radix keys of all the processes assigns contiguous
+// ranges of digits to the processes, with about global_size/size elements each.
+// The data are sent to their process with a single alltoallv and each process
+// sorts what it receives with omp_radix_sort(). A digit is never split between
+// two processes, so the balance depends on the largest digit of the histogram
+void MPI_Radix_sort(data_t **local_data, idx_t *local_size,
+                    idx_t global_size, int rank, int size,
+                    MPI_Datatype MPI_DATA_T) {
+
+    // Just sort locally in case there is only 1 process
+    if (size == 1) {
+        omp_radix_sort(*local_data, 0, *local_size);
+        return;
+    }
+
+    // Global range of the radix keys
+    uint64_t low = UINT64_MAX, high = 0;
+    #pragma omp parallel for reduction(min:low) reduction(max:high)
+    for (idx_t i = 0; i < *local_size; i++) {
+        uint64_t key = radix_key((*local_data)[i].data[HOT]);
+        if (key < low) { low = key; }
+        if (key > high) { high = key; }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &low, 1, MPI_UINT64_T, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &high, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+    if (low >= high) { return; } // all the keys are equal (or there are none)
+
+    int top = 64 - __builtin_clzll(low ^ high);
+    int shift = (top > RADIX_SPLIT_BITS) ? top - RADIX_SPLIT_BITS : 0;
+    int digits = 1 << RADIX_SPLIT_BITS;
+    uint64_t mask = (uint64_t)digits - 1;
+
+    // Global histogram of the digits: ranks[d] becomes the number of elements of
+    // all the processes with a smaller digit than d
+    idx_t *ranks = (idx_t *)calloc(digits, sizeof(idx_t));
+    #pragma omp parallel for reduction(+:ranks[:digits])
+    for (idx_t i = 0; i < *local_size; i++)
+        ranks[(radix_key((*local_data)[i].data[HOT]) >> shift) & mask]++;
+    MPI_Allreduce(MPI_IN_PLACE, ranks, digits, MPI_IDX_T, MPI_SUM, MPI_COMM_WORLD);
+
+    double *candidates = (double *)malloc(digits * sizeof(double));
+    idx_t offset = 0;
+    for (int d = 0; d < digits; d++) {
+        idx_t count = ranks[d];
+        ranks[d] = offset;
+        candidates[d] = d;
+        offset += count;
+    }
+
+    // The first digit of each process (but the first one) is the one whose rank is
+    // the nearest to an exact multiple of global_size/size, as for the PSRS splitters
+    double *pivots = (double *)malloc((size - 1) * sizeof(double));
+    idx_t max_bucket = select_splitters(candidates, ranks, digits, size, global_size, pivots);
+    if (qsort_tuning.report && rank == 0) {
+        double average = (double)global_size / size;
+        fprintf(stdout, "Radix split, processes 0-%d: max %lld, average %.1f, imbalance %.3f\n",
+                size - 1, (long long int)max_bucket, average,
+                (average > 0) ? max_bucket / average : 1.0);
+    }
+
+    int *owner = (int *)malloc(digits * sizeof(int));
+    for (int d = 0, p = 0; d < digits; d++) {
+        while (p < size - 1 && pivots[p] <= d)
+            p++;
+        owner[d] = p;
+    }
+
+    // Each thread counts the elements of its chunk to be sent to each process and
+    // scatters them in the send buffer after those of the threads with a smaller id
+    idx_t *send_counts = (idx_t *)calloc(size, sizeof(idx_t));
+    idx_t *send_displs = (idx_t *)malloc(size * sizeof(idx_t));
+    data_t *send_data = (data_t *)malloc(*local_size * sizeof(data_t));
+    idx_t **counts = NULL;
+
+    #pragma omp parallel
+    {
+        int nthreads = omp_get_num_threads();
+        int id = omp_get_thread_num();
+        chunk_t chunk = split(0, *local_size, nthreads, id);
+
+        #pragma omp single
+        counts = (idx_t **)malloc(nthreads * sizeof(idx_t *));
+
+        idx_t *count = (idx_t *)calloc(size, sizeof(idx_t));
+        counts[id] = count;
+        for (idx_t i = chunk.start; i <= chunk.end; i++)
+            count[owner[(radix_key((*local_data)[i].data[HOT]) >> shift) & mask]]++;
+
+        #pragma omp barrier // wait for all the counts before the prefix sum
+
+        #pragma omp single
+        {
+            idx_t position = 0;
+            for (int p = 0; p < size; p++) {
+                send_displs[p] = position;
+                for (int t = 0; t < nthreads; t++) {
+                    idx_t c = counts[t][p];
+                    counts[t][p] = position;
+                    position += c;
+                    send_counts[p] += c;
+                }
+            }
+        }
+
+        for (idx_t i = chunk.start; i <= chunk.end; i++)
+            send_data[count[owner[(radix_key((*local_data)[i].data[HOT]) >> shift) & mask]]++] = (*local_data)[i];
+
+        free(count);
+    }
+    free(counts);
+    free(*local_data);
+
+    // Each process sends and receives the sizes of the partitions and then the elements
+    idx_t *recv_counts = (idx_t *)malloc(size * sizeof(idx_t));
+    MPI_Alltoall(send_counts, 1, MPI_IDX_T, recv_counts, 1, MPI_IDX_T, MPI_COMM_WORLD);
+
+    idx_t *recv_displs = (idx_t *)malloc(size * sizeof(idx_t));
+    recv_displs[0] = 0;
+    for (int i = 1; i < size; i++)
+        recv_displs[i] = recv_displs[i-1] + recv_counts[i-1];
+    *local_size = recv_displs[size-1] + recv_counts[size-1];
+
+    *local_data = (data_t *)malloc(*local_size * sizeof(data_t));
+    MPI_Alltoallv_large(send_data, send_counts, send_displs,
+                        *local_data, recv_counts, recv_displs,
+                        MPI_COMM_WORLD, MPI_DATA_T);
+
+    // Each process sorts its partition
+    omp_radix_sort(*local_data, 0, *local_size);
+
+    // Freeing memory
+    free(ranks);
+    free(candidates);
+    free(pivots);
+    free(owner);
+    free(send_counts);
+    free(send_displs);
+    free(send_data);
+    free(recv_counts);
+    free(recv_displs);
+}
+
+#endif
@@ -0,0 +1,180 @@
+#include "qsort.h"
+
+// True if the current element of run a must be output before the one of run b.
+// Exhausted runs (and the dummy runs with index >= p) always lose, while equal
+// keys are taken from the run with the smaller index first (stable merge)
+static inline int beats(data_t **runs, idx_t *sizes, idx_t *pos, int p, int a, int b) {
+	if (b >= p || pos[b] >= sizes[b]) return 1;
+	if (a >= p || pos[a] >= sizes[a]) return 0;
+	double key_a = runs[a][pos[a]].data[HOT];
+	double key_b = runs[b][pos[b]].data[HOT];
+	return (key_a < key_b) || (key_a == key_b && a < b);
+}
+
+// Merges the p sorted runs runs[i][0 ... sizes[i]) into out using a loser tree:
+// every output element costs log2(p) comparisons
+void multiway_merge(data_t **runs, idx_t *sizes, int p, data_t *out) {
+	if (p <= 0) { return; }
+
+	// Number of leaves of the tree (power of 2)
+	int k = 1;
+	while (k < p) k <<= 1;
+
+	idx_t total = 0;
+	for (int i = 0; i < p; i++)
+		total += sizes[i];
+
+	// tree[0] is the overall winner, tree[1 ... k) the losers of each match
+	int *tree = (int *)malloc(k * sizeof(int));
+	int *winners = (int *)malloc(2 * k * sizeof(int));
+	idx_t *pos = (idx_t *)calloc(p, sizeof(idx_t));
+
+	// Play the initial tournament bottom-up
+	for (int i = 0; i < k; i++)
+		winners[k + i] = i;
+	for (int node = k - 1; node >= 1; node--) {
+		int a = winners[2 * node];
+		int b = winners[2 * node + 1];
+		if (beats(runs, sizes, pos, p, a, b)) {
+			winners[node] = a;
+			tree[node] = b;
+		} else {
+			winners[node] = b;
+			tree[node] = a;
+		}
+	}
+	tree[0] = winners[1];
+	free(winners);
+
+	for (idx_t o = 0; o < total; o++) {
+		// Output the current element of the winner run
+		int winner = tree[0];
+		out[o] = runs[winner][pos[winner]++];
+
+		// Replay the matches on the path from the winner leaf to the root
+		for (int node = (k + winner) >> 1; node >= 1; node >>= 1) {
+			if (beats(runs, sizes, pos, p, tree[node], winner)) {
+				int temp = tree[node];
+				tree[node] = winner;
+				winner = temp;
+			}
+		}
+		tree[0] = winner;
+	}
+
+	free(tree);
+	free(pos);
+}
+
+// Number of elements of data[lo ... hi) with key < key (or <= key if upper is set)
+static inline idx_t count_before(data_t *data, idx_t lo, idx_t hi, double key, int upper) {
+	while (lo < hi) {
+		idx_t mid = lo + (hi - lo) / 2;
+		if (data[mid].data[HOT] < key || (upper && data[mid].data[HOT] == key))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Multisequence selection: finds the positions split[i] in the p sorted runs such
+// that the elements before them are exactly the first rank elements of the merge
+// of the runs (in the same order used by multiway_merge()). This is the p-way
+// generalization of the merge-path split and allows to merge disjoint portions of
+// the output independently
+void multiway_split(data_t **runs, idx_t *sizes, int p, idx_t rank, idx_t *split) {
+	// The split position of each run is searched in [lo[i], hi[i]]
+	idx_t *lo = (idx_t *)calloc(p, sizeof(idx_t));
+	idx_t *hi = (idx_t *)malloc(p * sizeof(idx_t));
+	idx_t *count = (idx_t *)malloc(p * sizeof(idx_t));
+	for (int i = 0; i < p; i++)
+		hi[i] = sizes[i];
+
+	while (1) {
+		// Take the middle element of the widest search range as candidate
+		int j = -1;
+		for (int i = 0; i < p; i++)
+			if (hi[i] > lo[i] && (j == -1 || hi[i] - lo[i] > hi[j] - lo[j]))
+				j = i;
+		if (j == -1) { break; } // all the ranges are empty: lo is the split
+
+		idx_t m = lo[j] + (hi[j] - lo[j]) / 2;
+		double key = runs[j][m].data[HOT];
+
+		// Count the elements that come before the candidate in the merge
+		idx_t before = 0;
+		for (int i = 0; i < p; i++) {
+			if (i == j)
+				count[i] = m;
+			else
+				count[i] = count_before(runs[i], lo[i], hi[i], key, i < j);
+			before += count[i];
+		}
+
+		if (before == rank) { // the candidate is exactly at the split
+			for (int i = 0; i < p; i++)
+				lo[i] = hi[i] = count[i];
+		} else if (before < rank) { // the candidate and what is before it are on the left
+			for (int i = 0; i < p; i++)
+				lo[i] = count[i];
+			lo[j] = m + 1;
+		} else { // the candidate and what is after it are on the right
+			for (int i = 0; i < p; i++)
+				hi[i] = count[i];
+		}
+	}
+
+	memcpy(split, lo, p * sizeof(idx_t));
+	free(lo);
+	free(hi);
+	free(count);
+}
+
+#if defined(_OPENMP)
+
+// Merges the p sorted runs into out splitting the output in parts portions of the
+// same size, each merged by a different task. It must be called inside a parallel
+// region and returns when all the portions have been merged
+void omp_multiway_merge(data_t **runs, idx_t *sizes, int p, data_t *out, int parts) {
+	if (parts <= 1) {
+		multiway_merge(runs, sizes, p, out);
+		return;
+	}
+
+	idx_t total = 0;
+	for (int i = 0; i < p; i++)
+		total += sizes[i];
+
+	// The taskgroup waits for all the merging tasks
+	#pragma omp taskgroup
+	for (int q = 0; q < parts; q++) {
+		#pragma omp task firstprivate(q)
+		{
+			idx_t first = total * q / parts;
+			idx_t last = total * (q + 1) / parts;
+
+			// Portions of the runs that end up in out[first ... last)
+			idx_t *split_first = (idx_t *)malloc(p * sizeof(idx_t));
+			idx_t *split_last = (idx_t *)malloc(p * sizeof(idx_t));
+			multiway_split(runs, sizes, p, first, split_first);
+			multiway_split(runs, sizes, p, last, split_last);
+
+			data_t **sub_runs = (data_t **)malloc(p * sizeof(data_t *));
+			idx_t *sub_sizes = (idx_t *)malloc(p * sizeof(idx_t));
+			for (int i = 0; i < p; i++) {
+				sub_runs[i] = runs[i] + split_first[i];
+				sub_sizes[i] = split_last[i] - split_first[i];
+			}
+
+			multiway_merge(sub_runs, sub_sizes, p, out + first);
+
+			free(split_first);
+			free(split_last);
+			free(sub_runs);
+			free(sub_sizes);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,128 @@
+#include "qsort.h"
+
+#if defined(_OPENMP)
+
+// Recursion of omp_parallel_qsort() and omp_hyperquicksort() in a single parallel
+// region: at each level a group of count threads (with ids first ... first+count-1)
+// splits data[start ... end) around a common pivot, moving the low and high
+// elements of all its threads through the buffer of the workspace, and then
+// splits in two smaller groups, with a number of threads proportional to the
+// sizes of the two halves, until each thread sorts its range serially. The groups
+// synchronize with their own team_barrier(), so no nested parallel regions are
+// needed. With sort_chunks each thread sorts its chunk before the split, as in
+// the hyperquicksort. The team is made of nthreads/2^depth threads
+void omp_group_sort(data_t *data, idx_t start, idx_t end, compare_t cmp_ge, int depth, int sort_chunks) {
+
+	int team = omp_get_max_threads() >> depth;
+	if (team < 2 || end - start < 2) {
+		serial_qsort(data, start, end, cmp_ge);
+		return;
+	}
+
+	// Shared variables, from the workspace of the sorts: the buffer of the
+	// partitioning of the whole array and for each thread the number of its low and
+	// high elements, the pivot and the barrier of the group of which it is the first
+	// thread. All the levels use the same arrays
+	workspace_t *workspace = omp_workspace(end - start, 2 * (idx_t)team, team);
+	data_t *buffer = workspace->buffer;
+	idx_t *low_count = workspace->counts;
+	idx_t *high_count = workspace->counts + team;
+	double *pivots = workspace->pivots;
+	team_barrier_t *barriers = workspace->barriers;
+
+	#pragma omp parallel num_threads(team)
+	{
+		int id = omp_get_thread_num();
+
+		// Group of the thread and its part of the array
+		int first = 0, count = omp_get_num_threads();
+		idx_t group_start = start, group_end = end;
+		int attempts = 0;	// pivots that left one of the halves empty
+
+		while (1) {
+			idx_t group_size = group_end - group_start;
+
+			// A group of one thread (or with more threads than elements, or that could
+			// not find a pivot splitting the range) sorts its range serially
+			if (count == 1 || group_size < count || attempts == count) {
+				if (id == first)
+					serial_qsort(data, group_start, group_end, cmp_ge);
+				break;
+			}
+
+			// Each thread picks a chunk of the range of the group (and sorts it serially
+			// for the hyperquicksort)
+			chunk_t chunk = split(group_start, group_end, count, id - first);
+			if (sort_chunks)
+				serial_qsort(data, chunk.start, chunk.end+1, cmp_ge);
+
+			// One thread chooses the pivot for the group from the middle of its chunk,
+			// i.e. its median if sorted (another thread after each failed attempt)
+			if (id - first == attempts)
+				pivots[first] = data[chunk.start + (chunk.end - chunk.start)/2].data[HOT];
+
+			team_barrier(&barriers[first], count); // wait for the pivot
+
+			// Each thread finds the mid of its chunk, i.e. the index of the first element
+			// >= pivot, by a binary search if sorted or by partitioning it otherwise
+			idx_t mid = (sort_chunks) ? binary_search(data, chunk.start, chunk.end, pivots[first])
+									  : partitioning_low_high(data, chunk.start, chunk.end+1, pivots[first]);
+			mid -= chunk.start;
+
+			// Each thread writes the count of its low and high elements
+			low_count[id] = mid;
+			high_count[id] = chunk.size - mid;
+
+			team_barrier(&barriers[first], count); // wait for all the counts
+
+			// Each thread computes the positions of its low and high elements from the
+			// counts of the group (prefix sums of the threads before it and total)
+			idx_t total_low = 0, low_before = 0, high_before = 0;
+			for (int t = first; t < first + count; t++) {
+				total_low += low_count[t];
+				if (t < id) {
+					low_before += low_count[t];
+					high_before += high_count[t];
+				}
+			}
+
+			// Each thread scatters its low and high elements in their final positions
+			// in the shared buffer, all the threads move their own data at the same time
+			data_t *group_buffer = &buffer[group_start - start];
+			memcpy(&group_buffer[low_before], &data[chunk.start], mid * sizeof(data_t));
+			memcpy(&group_buffer[total_low + high_before], &data[chunk.start + mid], (chunk.size - mid) * sizeof(data_t));
+
+			team_barrier(&barriers[first], count); // wait for all the threads to scatter their data
+
+			// Each thread copies back the portion of the buffer corresponding to its chunk
+			memcpy(&data[chunk.start], &group_buffer[chunk.start - group_start], chunk.size * sizeof(data_t));
+
+			team_barrier(&barriers[first], count); // wait for all the threads to copy back
+
+			// A pivot leaving one half empty is tried again with another thread's pivot
+			if (total_low == 0 || total_low == group_size) {
+				attempts++;
+				continue;
+			}
+			attempts = 0;
+
+			// The group splits in two with the threads proportional to the sizes of the halves
+			int low_threads = (int)((count * total_low + group_size / 2) / group_size);
+			if (low_threads < 1) { low_threads = 1; }
+			if (low_threads > count - 1) { low_threads = count - 1; }
+
+			if (id - first < low_threads) {
+				count = low_threads;
+				group_end = group_start + total_low;
+			} else {
+				first += low_threads;
+				count -= low_threads;
+				group_start += total_low;
+			}
+		}
+	}
+
+	omp_workspace_release(workspace);
+}
+
+#endif
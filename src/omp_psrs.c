@@ -2,13 +2,20 @@
 
 #if defined(_OPENMP)
 
-void omp_psrs(data_t *data, int start, int end, compare_t cmp_ge) {
+void omp_psrs(data_t *data, idx_t start, idx_t end, compare_t cmp_ge) {
 
 	// Shared variables
 	double *samples = NULL;
-	int **prefix_matrix = NULL;
-	int *index = NULL;
-	int array_size = end - start;
+	idx_t *ranks = NULL;
+	idx_t **prefix_matrix = NULL;
+	idx_t array_size = end - start;
+	if (array_size < 2) { return; }
+
+	// The buffer used to redistribute the data and the rows of the prefix matrix
+	// come from the workspace of the sorts
+	int team = omp_get_max_threads();
+	workspace_t *workspace = omp_workspace(array_size, (idx_t)(team + 1) * (team + 1), team);
+	data_t *buffer = workspace->buffer;
 
 	#pragma omp parallel
 	{
@@ -22,21 +29,13 @@ void omp_psrs(data_t *data, int start, int end, compare_t cmp_ge) {
 		// Each thread sorts its chunk serially
 		serial_qsort(data, chunk.start, chunk.end+1, cmp_ge);
 
-		// One thread allocates memory for the index array
-		#pragma omp single nowait
-		index = (int *)malloc(array_size * sizeof(int));
-
-		// One thread allocates memory for the samples array
-		#pragma omp single nowait
-		samples = (double *)malloc(nthreads * nthreads * sizeof(double));
-
-		// Memory allocation for the (nthreads+1)*(nthreads+1) prefix_matrix
+		// Rows of the (nthreads+1)*(nthreads+1) prefix_matrix
 		#pragma omp single
 		{
-			prefix_matrix = (int **)malloc((nthreads+1) * sizeof(int *));
-			prefix_matrix[0] = (int *)malloc((nthreads+1) * sizeof(int));
+			prefix_matrix = (idx_t **)malloc((nthreads+1) * sizeof(idx_t *));
+			prefix_matrix[0] = workspace->counts;
 		}
-		prefix_matrix[id+1] = (int *)malloc((nthreads+1) * sizeof(int));
+		prefix_matrix[id+1] = workspace->counts + (idx_t)(id + 1) * (nthreads + 1);
 		
 		// Filling first row and first column with zeros
 		#pragma omp single nowait
@@ -45,35 +44,61 @@ void omp_psrs(data_t *data, int start, int end, compare_t cmp_ge) {
 		prefix_matrix[0][id+1] = 0;
 		prefix_matrix[id+1][0] = 0;
 
-		// Each thread samples "nthreads" pivots at regular intervals 
-		int step = array_size / (nthreads * nthreads);
-		#pragma omp parallel for
-		for (int i = 0; i < nthreads; i++) {
-			int sample_index = id * nthreads + i;
-			int data_index = chunk.start + i * step;
-			if (sample_index >= nthreads*nthreads || data_index >= array_size) {
-				fprintf(stderr, " ERROR: Index out of bounds in OMP PSRS sampling.\n");
-				exit(1);
+		// Each thread takes a regular sample of its sorted chunk of nthreads times the
+		// oversampling factor elements (only the first array_size chunks can be empty)
+		int s = qsort_tuning.oversampling * nthreads;
+		int nonempty = (array_size < nthreads) ? (int)array_size : nthreads;
+		idx_t max_chunk = (array_size + nthreads - 1) / nthreads;
+		double *pivots = (double *)malloc((nthreads - 1) * sizeof(double));
+
+		while (1) {
+			// One thread allocates memory for the samples and their ranks
+			#pragma omp single
+			{
+				samples = (double *)realloc(samples, nthreads * s * sizeof(double));
+				ranks = (idx_t *)realloc(ranks, nthreads * s * sizeof(idx_t));
 			}
-			samples[sample_index] = data[data_index].data[HOT];
-		}
 
-		#pragma omp barrier // wait for all the threads to fill the samples array before sorting it
+			if (chunk.size > 0)
+				regular_sample(data, chunk.start, chunk.end+1, s, &samples[id * s]);
 
-		// One thread sorts the samples array
-		#pragma omp single
-		qsort(samples, nthreads * nthreads, sizeof(double), compare_double);
+			#pragma omp barrier // wait for all the threads to fill the samples array before sorting it
 
-		// All the threads select the same nthreads-1 pivots from the samples array
-		double *pivots = (double *)malloc((nthreads - 1) * sizeof(double));
+			// One thread sorts the samples array
+			#pragma omp single
+			qsort(samples, nonempty * s, sizeof(double), compare_double);
+
+			// Without refinement all the threads select the same nthreads-1 pivots at
+			// regular positions of the samples array
+			if (qsort_tuning.epsilon <= 0) {
+				select_splitters(samples, NULL, nonempty * s, nthreads, array_size, pivots);
+				break;
+			}
 
-		// #pragma omp parallel for
-		for (int i = 0; i < nthreads - 1; i++) {
-			pivots[i] = samples[(i + 1) * nthreads];
-		} 
+			// Otherwise the threads compute the global rank of each sample, i.e. the number
+			// of smaller elements in all the sorted chunks...
+			#pragma omp for
+			for (int j = 0; j < nonempty * s; j++) {
+				ranks[j] = 0;
+				for (int t = 0; t < nonempty; t++) {
+					chunk_t other = split(start, end, nthreads, t);
+					ranks[j] += binary_search(data, other.start, other.end, samples[j]) - other.start;
+				}
+			}
+
+			// ...and select as pivots the samples with the nearest ranks to the ideal ones.
+			// If the largest partition is still above the cap, a new round doubles the
+			// oversampling (until the whole chunks are sampled)
+			idx_t max_bucket = select_splitters(samples, ranks, nonempty * s, nthreads, array_size, pivots);
+			if (max_bucket <= (1 + qsort_tuning.epsilon) * array_size / nthreads || s >= max_chunk)
+				break;
+			s *= 2;
+
+			#pragma omp barrier // wait for all the threads to select the pivots before sampling again
+		}
 
 		// Each thread partitions its chunk using the pivots (the mids array goes from index 0 to nthreads-1)
-		int *mids = p_partitioning(data, chunk.start, chunk.end+1, pivots, nthreads-1);
+		idx_t *mids = p_partitioning(data, chunk.start, chunk.end+1, pivots, nthreads-1);
 
 		// Each thread writes the number of elements in the other partitions except the last
 		#pragma omp parallel for
@@ -94,68 +119,65 @@ void omp_psrs(data_t *data, int start, int end, compare_t cmp_ge) {
 		#pragma omp barrier // wait for all prefix sums of rows to finish before prefix sum of last column
 
 		// Compute and store in an array the prefix sum of the last column of the prefix_matrix
-		int* prefix_sum = (int *)malloc((nthreads + 1) * sizeof(int));
+		idx_t* prefix_sum = (idx_t *)malloc((nthreads + 1) * sizeof(idx_t));
 		prefix_sum[0] = 0;
 		for (int i = 1; i < nthreads+1; i++) {
 			prefix_sum[i] = prefix_sum[i-1] + prefix_matrix[i][nthreads];
 		}
 
-		// Each thread writes the new element positions in the shared index array
-		for (int k = 1; k < nthreads; k++) {
-			for (int i = mids[k-1]; i < mids[k]; i++) {
-				index[chunk.start + i] = prefix_sum[k-1] + prefix_matrix[k][id] + (i - mids[k-1]);
-			}
-
-			// Last partition
-			for ( int i = mids[nthreads-1]; i < chunk.size; i++) {
-				index[chunk.start + i] = prefix_sum[nthreads-1] + prefix_matrix[nthreads][id] + (i - mids[nthreads-1]);
-			}
+		// Each thread scatters each of its partitions in the shared buffer, after the
+		// elements of the same partition coming from the threads with a smaller id.
+		// All the threads move their own data at the same time
+		for (int k = 0; k < nthreads; k++) {
+			idx_t partition_start = mids[k];
+			idx_t partition_end = (k < nthreads - 1) ? mids[k+1] : chunk.size;
+			memcpy(&buffer[prefix_sum[k] + prefix_matrix[k+1][id]],
+				   &data[chunk.start + partition_start],
+				   (partition_end - partition_start) * sizeof(data_t));
 		}
 
-		#pragma omp barrier // wait for all the threads to write their indexes before swapping
-
-		// One thread takes the job of reordering the elements
-		#pragma omp single
-		{
-			for (int i = 0; i < array_size; i++) {
-				while (index[i] != start + i) {
-					SWAP((void *)&data[start + i], (void *)&data[index[i]], sizeof(data_t));
-					SWAP((void *)&index[i], (void *)&index[index[i] - start], sizeof(int));
-				}
-			}
-		}
+		#pragma omp barrier // wait for all the threads to scatter their data before merging
 
-		// Finally each thread sorts serially a portion of the array that,
-		// looking at the last column, goes
+		// Partition id is now made of nthreads sorted runs (one from each thread) that
+		// are merged from the buffer directly into their final position in the array,
+		// which goes
 		// from:
-		int sstart = prefix_sum[id];
+		idx_t sstart = start + prefix_sum[id];
 		// to:
-		int send = prefix_sum[id] + prefix_matrix[id+1][nthreads];
+		idx_t send = start + prefix_sum[id] + prefix_matrix[id+1][nthreads];
+
+		data_t **runs = (data_t **)malloc(nthreads * sizeof(data_t *));
+		idx_t *run_sizes = (idx_t *)malloc(nthreads * sizeof(idx_t));
+		for (int t = 0; t < nthreads; t++) {
+			runs[t] = &buffer[prefix_sum[id] + prefix_matrix[id+1][t]];
+			run_sizes[t] = prefix_matrix[id+1][t+1] - prefix_matrix[id+1][t];
+		}
 
-		serial_qsort(data, sstart, send, cmp_ge);
+		// Partitions larger than the average are split in several merging tasks, so
+		// that the threads that are done with their own partition can help
+		int parts = (int)(((send - sstart) * nthreads + array_size - 1) / array_size);
+		omp_multiway_merge(runs, run_sizes, nthreads, &data[sstart], parts);
 
 		// Free memory
 		free(pivots);
 		free(mids);
 		free(prefix_sum);
-		
-		// Freeing the prefix matrix
-		free(prefix_matrix[id+1]);
+		free(runs);
+		free(run_sizes);
 
 		// Freeing the shared variables
 		#pragma omp barrier
 		#pragma omp single nowait
-		{
-			free(prefix_matrix[0]);
-			free(prefix_matrix);
-		}
+		free(prefix_matrix);
 
 		#pragma omp single nowait
 		free(samples);
 
 		#pragma omp single nowait
-		free(index);
+		free(ranks);
 	}
+
+	omp_workspace_release(workspace);
 }
 
 #endif
@@ -0,0 +1,154 @@
+#include "qsort.h"
+
+#if defined(_OPENMP)
+
+// Radix key of a record and its position in the bucket being sorted
+typedef struct {
+	uint64_t key;
+	idx_t index;
+} radix_pair_t;
+
+// Sorts the n records of a bucket by the lowest bits of their radix keys (the
+// higher ones are the same for all of them) and writes them in order to out. The
+// (key, index) pairs are sorted by LSD passes of RADIX_BITS bits, skipping the
+// digits that are the same for the whole bucket, and each record is then moved
+// once. The pairs and temp arrays of capacity elements are reused between buckets
+static void sort_bucket(data_t *in, idx_t n, int bits, data_t *out,
+						radix_pair_t **pairs, radix_pair_t **temp, idx_t *capacity) {
+	if (n == 0) { return; }
+
+	// Small buckets are sorted by the comparison sort
+	if (n <= RADIX_THRESHOLD) {
+		serial_qsort(in, 0, n, compare_ge);
+		memcpy(out, in, n * sizeof(data_t));
+		return;
+	}
+
+	if (n > *capacity) {
+		*capacity = n;
+		*pairs = (radix_pair_t *)realloc(*pairs, n * sizeof(radix_pair_t));
+		*temp = (radix_pair_t *)realloc(*temp, n * sizeof(radix_pair_t));
+	}
+	radix_pair_t *src = *pairs, *dst = *temp;
+	for (idx_t i = 0; i < n; i++) {
+		src[i].key = radix_key(in[i].data[HOT]);
+		src[i].index = i;
+	}
+
+	idx_t count[1 << RADIX_BITS];
+	uint64_t mask = ((uint64_t)1 << RADIX_BITS) - 1;
+	for (int shift = 0; shift < bits; shift += RADIX_BITS) {
+		memset(count, 0, sizeof(count));
+		for (idx_t i = 0; i < n; i++)
+			count[(src[i].key >> shift) & mask]++;
+		if (count[(src[0].key >> shift) & mask] == n)
+			continue;	// same digit for all the keys
+
+		idx_t offset = 0;
+		for (int d = 0; d < (1 << RADIX_BITS); d++) {
+			idx_t c = count[d];
+			count[d] = offset;
+			offset += c;
+		}
+		for (idx_t i = 0; i < n; i++)
+			dst[count[(src[i].key >> shift) & mask]++] = src[i];
+
+		radix_pair_t *swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	for (idx_t i = 0; i < n; i++)
+		out[i] = in[src[i].index];
+}
+
+// Parallel radix sort (ascending order of data[HOT]): a first MSD pass on the
+// highest RADIX_BITS bits that differ among the keys scatters the records in
+// buckets, with per-thread histograms and their prefix sums giving to each thread
+// its own positions in each bucket. The buckets are then sorted independently by
+// the threads (see sort_bucket())
+void omp_radix_sort(data_t *data, idx_t start, idx_t end) {
+	idx_t array_size = end - start;
+	if (array_size < 2) { return; }
+
+	// Range of the radix keys: the bits above the highest one that differs between
+	// the smallest and the largest key are the same for all of them
+	uint64_t low = UINT64_MAX, high = 0;
+	#pragma omp parallel for reduction(min:low) reduction(max:high)
+	for (idx_t i = start; i < end; i++) {
+		uint64_t key = radix_key(data[i].data[HOT]);
+		if (key < low) { low = key; }
+		if (key > high) { high = key; }
+	}
+	if (low == high) { return; } // all the keys are equal
+
+	int top = 64 - __builtin_clzll(low ^ high);
+	int shift = (top > RADIX_BITS) ? top - RADIX_BITS : 0;
+	int buckets = 1 << RADIX_BITS;
+	uint64_t mask = (uint64_t)buckets - 1;
+
+	// Shared variables, from the workspace of the sorts: the buffer, the start of
+	// each bucket and the histogram of each thread
+	int team = omp_get_max_threads();
+	workspace_t *workspace = omp_workspace(array_size, (idx_t)(team + 1) * buckets + 1, team);
+	data_t *buffer = workspace->buffer;
+	idx_t *bucket_start = workspace->counts;
+	idx_t *counts = workspace->counts + buckets + 1;
+
+	#pragma omp parallel
+	{
+		// Number of threads and id
+		int nthreads = omp_get_num_threads();
+		int id = omp_get_thread_num();
+
+		// Each thread picks a chunk of the array
+		chunk_t chunk = split(start, end, nthreads, id);
+
+		// Each thread counts the elements of its chunk in each bucket
+		idx_t *count = &counts[(idx_t)id * buckets];
+		memset(count, 0, buckets * sizeof(idx_t));
+		for (idx_t i = chunk.start; i <= chunk.end; i++)
+			count[(radix_key(data[i].data[HOT]) >> shift) & mask]++;
+
+		#pragma omp barrier // wait for all the histograms before the prefix sum
+
+		// One thread computes the prefix sum of the histograms, bucket by bucket and
+		// thread by thread: each count becomes the position of the first element of
+		// the thread in the bucket
+		#pragma omp single
+		{
+			idx_t offset = 0;
+			for (int b = 0; b < buckets; b++) {
+				bucket_start[b] = offset;
+				for (int t = 0; t < nthreads; t++) {
+					idx_t c = counts[(idx_t)t * buckets + b];
+					counts[(idx_t)t * buckets + b] = offset;
+					offset += c;
+				}
+			}
+			bucket_start[buckets] = offset;
+		}
+
+		// Each thread scatters its elements in the buffer
+		for (idx_t i = chunk.start; i <= chunk.end; i++)
+			buffer[count[(radix_key(data[i].data[HOT]) >> shift) & mask]++] = data[i];
+
+		#pragma omp barrier // wait for all the threads to scatter their data before sorting
+
+		// The threads sort the buckets from the buffer into their final position
+		radix_pair_t *pairs = NULL, *temp = NULL;
+		idx_t capacity = 0;
+		#pragma omp for schedule(dynamic)
+		for (int b = 0; b < buckets; b++)
+			sort_bucket(&buffer[bucket_start[b]], bucket_start[b+1] - bucket_start[b], shift,
+						&data[start + bucket_start[b]], &pairs, &temp, &capacity);
+
+		// Free memory
+		free(pairs);
+		free(temp);
+	}
+
+	omp_workspace_release(workspace);
+}
+
+#endif
@@ -0,0 +1,251 @@
+#include "qsort.h"
+
+#if defined(_OPENMP)
+
+// Splitters of a level of the sample sort: the sorted splitters and the same
+// splitters as an implicit binary search tree (tree[1] is the root and the
+// children of tree[j] are tree[2j] and tree[2j+1]), so that the bucket of an
+// element is found with log2(buckets) comparisons and no branches
+typedef struct {
+	double splitters[SAMPLE_BUCKETS];
+	double tree[SAMPLE_BUCKETS];
+	int buckets;		// power of two, the splitters are buckets-1
+	int log_buckets;
+	int distinct;		// number of distinct splitters
+} classifier_t;
+
+// Fills the tree with the sorted splitters by an in-order visit
+static void fill_tree(classifier_t *c, int j, int *next) {
+	if (j >= c->buckets) { return; }
+	fill_tree(c, 2 * j, next);
+	c->tree[j] = c->splitters[(*next)++];
+	fill_tree(c, 2 * j + 1, next);
+}
+
+// Chooses the splitters of data[0 ... n) from a random sample of SAMPLE_OVERSAMPLING
+// elements per bucket. The duplicated splitters are removed, and the last one is
+// repeated to fill the tree (the buckets after it stay empty)
+static void build_classifier(data_t *data, idx_t n, uint64_t seed, classifier_t *c) {
+	c->buckets = 2;
+	c->log_buckets = 1;
+	while (c->buckets < SAMPLE_BUCKETS && n / (2 * c->buckets) >= SAMPLE_THRESHOLD) {
+		c->buckets *= 2;
+		c->log_buckets++;
+	}
+
+	int s = SAMPLE_OVERSAMPLING * c->buckets;
+	double *samples = (double *)malloc(s * sizeof(double));
+	for (int i = 0; i < s; i++) {
+		// xorshift64 generator
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		samples[i] = data[seed % n].data[HOT];
+	}
+	qsort(samples, s, sizeof(double), compare_double);
+
+	c->distinct = 0;
+	for (int i = 1; i < c->buckets; i++) {
+		double splitter = samples[(long long int)i * s / c->buckets];
+		if (c->distinct == 0 || splitter > c->splitters[c->distinct - 1])
+			c->splitters[c->distinct++] = splitter;
+	}
+	for (int i = c->distinct; i < c->buckets - 1; i++)
+		c->splitters[i] = c->splitters[c->distinct - 1];
+
+	int next = 0;
+	fill_tree(c, 1, &next);
+	free(samples);
+}
+
+// Bucket of a key: bucket b holds the keys in (splitters[b-1], splitters[b]), bucket
+// 2b, or equal to splitters[b], bucket 2b+1 (an equality bucket, which needs no
+// sorting). With many equal keys these end up in the equality buckets instead of
+// being partitioned again and again
+static inline int classify(const classifier_t *c, double key) {
+	int j = 1;
+	for (int l = 0; l < c->log_buckets; l++)
+		j = 2 * j + (key > c->tree[j]);
+	int b = j - c->buckets;
+	return 2 * b + (b < c->distinct && key == c->splitters[b]);
+}
+
+// Moves the elements of data[from ... to) to their buckets in dst, where positions
+// gives the next free position of each bucket. The elements are first copied in a
+// small block buffer for each bucket, which is flushed to dst when full, so that
+// the writes to dst are made of whole blocks
+static void scatter(data_t *data, idx_t from, idx_t to, unsigned char *oracle,
+					data_t *dst, idx_t *positions, int buckets) {
+	data_t *blocks = (data_t *)malloc(buckets * SAMPLE_BLOCK * sizeof(data_t));
+	int *fill = (int *)calloc(buckets, sizeof(int));
+
+	for (idx_t i = from; i < to; i++) {
+		int b = oracle[i];
+		blocks[b * SAMPLE_BLOCK + fill[b]++] = data[i];
+		if (fill[b] == SAMPLE_BLOCK) {
+			memcpy(&dst[positions[b]], &blocks[b * SAMPLE_BLOCK], SAMPLE_BLOCK * sizeof(data_t));
+			positions[b] += SAMPLE_BLOCK;
+			fill[b] = 0;
+		}
+	}
+
+	for (int b = 0; b < buckets; b++) {
+		memcpy(&dst[positions[b]], &blocks[b * SAMPLE_BLOCK], fill[b] * sizeof(data_t));
+		positions[b] += fill[b];
+	}
+
+	free(blocks);
+	free(fill);
+}
+
+static void sample_sort(data_t *, data_t *, idx_t, int, int, compare_t);
+
+// Sorts the buckets of a level, which are in b[bucket_start[i] ... bucket_start[i+1]),
+// into b if to_b is set, otherwise into a (the other array is the buffer). The
+// largest buckets are sorted by new tasks
+static void sort_buckets(data_t *a, data_t *b, idx_t *bucket_start, int buckets,
+						 int to_b, int depth, compare_t cmp_ge) {
+	for (int i = 0; i < buckets; i++) {
+		idx_t first = bucket_start[i];
+		idx_t size = bucket_start[i+1] - first;
+		if (size == 0) { continue; }
+
+		if (i % 2 == 1) {
+			// Equality bucket: already sorted
+			if (!to_b)
+				memcpy(&a[first], &b[first], size * sizeof(data_t));
+		} else if (size > SAMPLE_THRESHOLD) {
+			#pragma omp task
+			sample_sort(&b[first], &a[first], size, !to_b, depth - 1, cmp_ge);
+		} else {
+			sample_sort(&b[first], &a[first], size, !to_b, depth - 1, cmp_ge);
+		}
+	}
+}
+
+// Sorts the n elements of a into b if to_b is set, otherwise into a, using the
+// other array as the buffer. Each level classifies the elements in the buckets
+// (serially, the parallelism comes from the tasks of the buckets) and scatters
+// them from a to b
+static void sample_sort(data_t *a, data_t *b, idx_t n, int to_b, int depth, compare_t cmp_ge) {
+	if (n <= SAMPLE_THRESHOLD || depth <= 0) {
+		serial_qsort(a, 0, n, cmp_ge);
+		if (to_b)
+			memcpy(b, a, n * sizeof(data_t));
+		return;
+	}
+
+	classifier_t c;
+	build_classifier(a, n, 0x9E3779B97F4A7C15ULL ^ (uint64_t)n, &c);
+	int buckets = 2 * c.buckets;
+
+	unsigned char *oracle = (unsigned char *)malloc(n * sizeof(unsigned char));
+	idx_t *bucket_start = (idx_t *)calloc(buckets + 1, sizeof(idx_t));
+	idx_t *positions = (idx_t *)malloc(buckets * sizeof(idx_t));
+	for (idx_t i = 0; i < n; i++) {
+		oracle[i] = (unsigned char)classify(&c, a[i].data[HOT]);
+		bucket_start[oracle[i] + 1]++;
+	}
+	for (int i = 0; i < buckets; i++) {
+		bucket_start[i+1] += bucket_start[i];
+		positions[i] = bucket_start[i];
+	}
+
+	scatter(a, 0, n, oracle, b, positions, buckets);
+	free(oracle);
+	free(positions);
+
+	sort_buckets(a, b, bucket_start, buckets, to_b, depth, cmp_ge);
+	free(bucket_start);
+}
+
+// Parallel sample sort (in the style of the super scalar sample sort and IPS4o):
+// the elements are classified in up to 2*SAMPLE_BUCKETS buckets by an implicit
+// search tree of splitters chosen from an oversampled random sample, and scattered
+// to a buffer through per-thread block buffers. All the threads classify and
+// scatter their chunk of the first level, with per-thread histograms and their
+// prefix sums giving to each thread its own positions in each bucket. The buckets
+// are then sorted recursively by tasks. The splitters classify the elements in
+// ascending order of the data[HOT] field, so only compare_ge is sorted this way:
+// any other comparison function falls back to omp_task_qsort()
+void omp_sample_sort(data_t *data, idx_t start, idx_t end, compare_t cmp_ge) {
+	idx_t array_size = end - start;
+	if (array_size <= SAMPLE_THRESHOLD) {
+		serial_qsort(data, start, end, cmp_ge);
+		return;
+	}
+	if (cmp_ge != compare_ge) {
+		#pragma omp parallel
+		#pragma omp single
+		omp_task_qsort(data, start, end, cmp_ge);
+		return;
+	}
+	data += start;
+
+	// Shared variables
+	classifier_t c;
+	build_classifier(data, array_size, 0x9E3779B97F4A7C15ULL ^ (uint64_t)array_size, &c);
+	int buckets = 2 * c.buckets;
+	int depth = depth_limit(array_size);
+
+	// The buffer, the start of each bucket and the histogram of each thread come
+	// from the workspace of the sorts
+	int team = omp_get_max_threads();
+	workspace_t *workspace = omp_workspace(array_size, (idx_t)(team + 1) * buckets + 1, team);
+	data_t *buffer = workspace->buffer;
+	idx_t *bucket_start = workspace->counts;
+	idx_t *counts = workspace->counts + buckets + 1;
+	unsigned char *oracle = (unsigned char *)malloc(array_size * sizeof(unsigned char));
+
+	#pragma omp parallel
+	{
+		// Number of threads and id
+		int nthreads = omp_get_num_threads();
+		int id = omp_get_thread_num();
+
+		// Each thread picks a chunk of the array
+		chunk_t chunk = split(0, array_size, nthreads, id);
+
+		// Each thread classifies the elements of its chunk
+		idx_t *count = &counts[(idx_t)id * buckets];
+		memset(count, 0, buckets * sizeof(idx_t));
+		for (idx_t i = chunk.start; i <= chunk.end; i++) {
+			oracle[i] = (unsigned char)classify(&c, data[i].data[HOT]);
+			count[oracle[i]]++;
+		}
+
+		#pragma omp barrier // wait for all the histograms before the prefix sum
+
+		// One thread computes the prefix sum of the histograms, bucket by bucket and
+		// thread by thread: each count becomes the position of the first element of
+		// the thread in the bucket
+		#pragma omp single
+		{
+			idx_t offset = 0;
+			for (int b = 0; b < buckets; b++) {
+				bucket_start[b] = offset;
+				for (int t = 0; t < nthreads; t++) {
+					idx_t size = counts[(idx_t)t * buckets + b];
+					counts[(idx_t)t * buckets + b] = offset;
+					offset += size;
+				}
+			}
+			bucket_start[buckets] = offset;
+		}
+
+		// Each thread scatters its chunk in the buffer
+		scatter(data, chunk.start, chunk.end + 1, oracle, buffer, count, buckets);
+
+		#pragma omp barrier // wait for all the threads to scatter their data before sorting
+
+		// One thread creates the tasks sorting the buckets from the buffer back into
+		// the array, the others execute them
+		#pragma omp single
+		sort_buckets(data, buffer, bucket_start, buckets, 0, depth, cmp_ge);
+	}
+
+	free(oracle);
+	omp_workspace_release(workspace);
+}
+
+#endif
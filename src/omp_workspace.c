@@ -0,0 +1,86 @@
+#include "qsort.h"
+
+#if defined(_OPENMP)
+
+// Cached workspace, reused by the following sorts while it is not in use. A
+// workspace is owned by a single sort call: it is taken with omp_workspace() at
+// the start of the call, holds the scratch memory of all its threads and levels,
+// and is given back with omp_workspace_release() at its end. Only the memory
+// outlives the call, until omp_workspace_free()
+static workspace_t cached = {NULL, 0, NULL, 0, NULL, NULL, 0, 0};
+
+// Grows the arrays of workspace to at least size elements, counts counters and
+// threads pivots and barriers (the content is not kept)
+static void grow(workspace_t *workspace, idx_t size, idx_t counts, int threads) {
+	if (size > workspace->size) {
+		free(workspace->buffer);
+		workspace->buffer = (data_t *)malloc(size * sizeof(data_t));
+		workspace->size = size;
+	}
+	if (counts > workspace->counts_size) {
+		free(workspace->counts);
+		workspace->counts = (idx_t *)malloc(counts * sizeof(idx_t));
+		workspace->counts_size = counts;
+	}
+	if (threads > workspace->threads) {
+		free(workspace->pivots);
+		free(workspace->barriers);
+		workspace->pivots = (double *)malloc(threads * sizeof(double));
+		workspace->barriers = (team_barrier_t *)malloc(threads * sizeof(team_barrier_t));
+		workspace->threads = threads;
+	}
+	memset(workspace->barriers, 0, workspace->threads * sizeof(team_barrier_t));
+}
+
+// Returns a workspace of the OpenMP sorts with a buffer of at least size elements,
+// at least counts counters and a pivot and a barrier for each of the threads. The
+// cached workspace is returned (grown if needed) when it is not in use, so that
+// repeated sorts do not allocate (and fault in) their buffers again; otherwise,
+// e.g. when two sorts run at the same time, a new one is allocated. It must be
+// given back with omp_workspace_release()
+workspace_t *omp_workspace(idx_t size, idx_t counts, int threads) {
+	workspace_t *workspace = NULL;
+	#pragma omp critical(qsort_workspace)
+	if (!cached.busy) {
+		cached.busy = 1;
+		workspace = &cached;
+	}
+
+	if (workspace == NULL) {
+		workspace = (workspace_t *)calloc(1, sizeof(workspace_t));
+		workspace->busy = 1;
+	}
+
+	grow(workspace, size, counts, threads);
+	return workspace;
+}
+
+// Gives back a workspace returned by omp_workspace()
+void omp_workspace_release(workspace_t *workspace) {
+	if (workspace != &cached) {
+		free(workspace->buffer);
+		free(workspace->counts);
+		free(workspace->pivots);
+		free(workspace->barriers);
+		free(workspace);
+		return;
+	}
+
+	#pragma omp critical(qsort_workspace)
+	cached.busy = 0;
+}
+
+// Frees the memory of the cached workspace, if not in use (it is allocated again
+// by the next sort using it)
+void omp_workspace_free(void) {
+	#pragma omp critical(qsort_workspace)
+	if (!cached.busy) {
+		free(cached.buffer);
+		free(cached.counts);
+		free(cached.pivots);
+		free(cached.barriers);
+		cached = (workspace_t){NULL, 0, NULL, 0, NULL, NULL, 0, 0};
+	}
+}
+
+#endif
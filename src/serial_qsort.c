@@ -1,32 +1,20 @@
 #include "qsort.h"
 
-void serial_qsort(data_t *data, int start, int end, compare_t cmp_ge) {
+void serial_qsort(data_t *data, idx_t start, idx_t end, compare_t cmp_ge) {
 
-	#if defined(DEBUG)
-	#define CHECK                                                                   \
-	{                                                                               \
-		if (verify_partitioning(data, start, end, mid))                             \
-		{                                                                           \
-			printf("partitioning is wrong\n");                                      \
-			printf("%4d, %4d (%4d, %g) -> %4d, %4d  +  %4d, %4d\n",                 \
-				start, end, mid, data[mid].data[HOT], start, mid, mid + 1, end);    \
-			show_array(data, start, end);                                           \
-		}                                                                           \
+	// In leaf key mode the ascending sorts run on the (key, index) pairs and the
+	// records are moved only once at the end of this sort
+	if (qsort_tuning.leaf_keys && cmp_ge == compare_ge) {
+		serial_qsort_by_key(data, start, end);
+		return;
 	}
-	#else
-	#define CHECK
-	#endif
 
-		int size = end - start;
-		if (size > 2) { // if the size is >2 we recursively sort the two halves
-			int mid = partitioning(data, start, end, cmp_ge);
-
-			CHECK; // check the partitioning only if DEBUG is defined
-
-			serial_qsort(data, start, mid, cmp_ge);   // sort the left half
-			serial_qsort(data, mid + 1, end, cmp_ge); // sort the right half
-		} else { // if the size is 2 we swap the two elements if necessary
-			if ((size == 2) && cmp_ge((void *)&data[start], (void *)&data[end - 1]))
-				SWAP((void *)&data[start], (void *)&data[end - 1], sizeof(data_t));
-		}
+	// The library comparison functions have specialized kernels with the
+	// comparison inlined, any other function is called through the pointer
+	if (cmp_ge == compare_ge)
+		sort_kernel_ge(data, start, end);
+	else if (cmp_ge == compare_le)
+		sort_kernel_le(data, start, end);
+	else
+		sort_kernel(data, start, end, cmp_ge);
 }
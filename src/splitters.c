@@ -0,0 +1,48 @@
+#include "qsort.h"
+
+// Takes s samples of the sorted data[start ... end) (not empty) at regular
+// intervals, the first of each of s equal parts (as in the classic PSRS, so that
+// the sample at position i*s of the p*s sorted samples estimates the i/p quantile)
+void regular_sample(data_t *data, idx_t start, idx_t end, int s, double *samples) {
+	idx_t size = end - start;
+	for (int i = 0; i < s; i++)
+		samples[i] = data[start + i * size / s].data[HOT];
+}
+
+// Chooses the p-1 splitters of the PSRS algorithms from the m sorted candidates.
+// Without ranks they are taken at regular positions of the candidates (as in the
+// classic PSRS), otherwise ranks[j] must be the global number of elements smaller
+// than candidates[j] and each splitter is the candidate whose rank is the nearest
+// to an exact multiple of n/p. In that case it returns the size of the largest
+// bucket, otherwise -1
+idx_t select_splitters(double *candidates, idx_t *ranks, int m, int p, idx_t n, double *pivots) {
+	if (m == 0) {
+		for (int i = 0; i < p - 1; i++)
+			pivots[i] = 0;
+		return (ranks == NULL) ? -1 : n;
+	}
+
+	if (ranks == NULL) {
+		for (int i = 1; i < p; i++)
+			pivots[i-1] = candidates[(long long int)i * m / p];
+		return -1;
+	}
+
+	// The ranks are non-decreasing, so the nearest candidate to each target moves forward
+	int j = 0;
+	idx_t previous = 0;
+	idx_t max_bucket = 0;
+	for (int i = 1; i < p; i++) {
+		idx_t target = i * n / p;
+		while (j + 1 < m && llabs(ranks[j+1] - target) <= llabs(ranks[j] - target))
+			j++;
+		pivots[i-1] = candidates[j];
+		if (ranks[j] - previous > max_bucket)
+			max_bucket = ranks[j] - previous;
+		previous = ranks[j];
+	}
+	if (n - previous > max_bucket)
+		max_bucket = n - previous;
+
+	return max_bucket;
+}